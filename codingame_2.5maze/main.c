@@ -1,6 +1,14 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 
 #define DIR_L 0
@@ -49,31 +57,440 @@ static int goDir(int *nx, int *ny, int x, int y, int dir, int w, int h)
     return 0;
 }
 
-static int checkStepBack(struct MazeNode *treeMaze, int x, int y, int level)
+/*********************************** BITSET ***********************************/
+
+#define NB_LEVEL 2
+
+static uint64_t *bitsetAlloc(long nbBit)
+{
+    return calloc((nbBit + 63) / 64, sizeof(uint64_t));
+}
+
+static inline int bitTest(const uint64_t *bits, long i)
+{
+    return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void bitSet(uint64_t *bits, long i)
+{
+    bits[i >> 6] |= 1ull << (i & 63);
+}
+
+static inline void bitClear(uint64_t *bits, long i)
+{
+    bits[i >> 6] &= ~(1ull << (i & 63));
+}
+
+/*
+Positions on the path from the root to the node being built, keyed like the
+states: (x + y * w) * NB_LEVEL + level. A bridge is only marked at the level
+it was crossed, any other tile at both levels, so that a position may be
+crossed again only at the other level of a bridge. As in the former
+ancestor walk, the bridge level compared is the one before the move.
+*/
+static int checkOnPath(const uint64_t *onPath, char nc, int ncell, int level)
+{
+    if (nc == 'X')
+        return bitTest(onPath, (long)ncell * NB_LEVEL + level) ? -1 : 0;
+    return bitTest(onPath, (long)ncell * NB_LEVEL) ? -1 : 0;
+}
+
+/*
+Move rules: return the level after stepping from tile c, at level, onto the
+next tile nc in direction d, or -1 if that move is not allowed.
+*/
+static int stepRule(char c, char nc, int d, int level)
 {
-    if (treeMaze->prev != NULL)
+    // Cannot go L/R on vertical slope
+    if (c == '|' && (d == DIR_L || d == DIR_R))
+        return -1;
+    // Cannot go U/D on horizontal slope
+    if (c == '-' && (d == DIR_U || d == DIR_D))
+        return -1;
+
+    // Cannot go on high wall
+    if (nc == '#')
+        return -1;
+
+    // If on the floor...
+    if (c == '.')
     {
-        // If it is the same position
-        if (x == treeMaze->prev->x && y == treeMaze->prev->y)
-        {
-            // Bridge special case
-            if (treeMaze->prev->c == 'X')
-            {
-                if (level == treeMaze->prev->level)
-                    return -1;
-            }
-            else
-                return -1;
-        }
+        // Cannot go straight on short wall
+        if (nc == '+')
+            return -1;
+    }
 
-        int ret = checkStepBack(treeMaze->prev, x, y, level);
-        if (ret != 0)
-            return ret;
+    // If on a short wall...
+    if (c == '+')
+    {
+        // Cannot go straight on the floor
+        if (nc == '.')
+            return -1;
     }
-    
+
+    // Cannot cross slopes
+    if (nc == '|' && (d == DIR_L || d == DIR_R))
+        return -1;
+    if (nc == '-' && (d == DIR_U || d == DIR_D))
+        return -1;
+
+    // A level 1 slope cannot lead to another short wall (different level of short walls not permitted)
+    if ((c == '|' || c == '-') && level == 1 && nc == '+')
+        return -1;
+    // A level 0 slope cannot lead to another floor (different level of floors not permitted)
+    if ((c == '|' || c == '-') && level == 0 && nc == '.')
+        return -1;
+
+    // Level 0 bridges cannot lead to shorts walls
+    if (c == 'X' && level == 0 && nc == '+')
+        return -1;
+    // Level 1 bridges cannot lead to floors
+    if (c == 'X' && level == 1 && nc == '.')
+        return -1;
+
+    // Leaving a slope switches level
+    if (c == '|' || c == '-')
+        return 1 - level;
+    return level;
+}
+
+/*
+The rules above are compiled by initRules() into g_rule, indexed by the kind
+of both tiles, the direction and the level. Every character that is none of
+the six tiles above behaves the same, as TILE_OTHER. Build with
+-DCHECK_RULES to check g_rule against stepRule() on every character pair.
+*/
+enum Tile
+{
+    TILE_FLOOR,     // '.'
+    TILE_SHORT,     // '+'
+    TILE_HIGH,      // '#'
+    TILE_VSLOPE,    // '|'
+    TILE_HSLOPE,    // '-'
+    TILE_BRIDGE,    // 'X'
+    TILE_OTHER,
+    TILE_PAD,       // around the map in struct Maze: no move onto or from it
+    NB_TILE
+};
+
+static const char tileChar[NB_TILE] = {'.', '+', '#', '|', '-', 'X', '?', '#'};
+
+static uint8_t     g_tileOf[256];
+static signed char g_rule[NB_TILE][NB_TILE][NB_DIR][NB_LEVEL];
+static uint8_t     g_flip[NB_TILE];    // 1 if leaving that tile switches level
+
+static void initRules(void)
+{
+    int c, t, nt, d, l;
+
+    for (c = 0; c < 256; c++)
+        g_tileOf[c] = TILE_OTHER;
+    for (t = 0; t < TILE_OTHER; t++)
+        g_tileOf[(unsigned char)tileChar[t]] = t;
+
+    for (t = 0; t < NB_TILE; t++)
+    {
+        g_flip[t] = stepRule(tileChar[t], '?', DIR_U, 0) == 1 ||
+                    stepRule(tileChar[t], '?', DIR_L, 0) == 1;
+        for (nt = 0; nt < NB_TILE; nt++)
+            for (d = 0; d < NB_DIR; d++)
+                for (l = 0; l < NB_LEVEL; l++)
+                    g_rule[t][nt][d][l] = t == TILE_PAD ? -1 :
+                                          stepRule(tileChar[t], tileChar[nt], d, l);
+    }
+}
+
+#ifdef CHECK_RULES
+static int checkRules(void)
+{
+    int c, nc, d, l, ret = 0;
+
+    for (c = 1; c < 256; c++)
+        for (nc = 1; nc < 256; nc++)
+            for (d = 0; d < NB_DIR; d++)
+                for (l = 0; l < NB_LEVEL; l++)
+                {
+                    int r = g_rule[g_tileOf[c]][g_tileOf[nc]][d][l];
+                    if (r != stepRule(c, nc, d, l) ||
+                        (r >= 0 && r != (l ^ g_flip[g_tileOf[c]])))
+                    {
+                        fprintf(stderr, "rule '%c' -> '%c' d=%d l=%d: %d\n", c, nc, d, l, r);
+                        ret = -1;
+                    }
+                }
+    return ret;
+}
+#endif
+
+/*
+A loaded maze, stored for the search loops:
+- Cells are numbered by blocks of MAZE_BLOCK x MAZE_BLOCK, row-major inside
+  a block and from block to block, so that the cells above and below are
+  mostly in the same block and the same pages. The map starts at (1, 1) and
+  is padded with TILE_PAD up to whole blocks: a move from a map cell always
+  lands in the grid.
+- The tile kinds are packed 2 per byte, which is all that is needed to find
+  the moves, so that 10^9 cells take 500MB. Cells are numbered in an int,
+  up to MAZE_MAX_CELL, and states in a long.
+- Up to MAZE_MAX_NBR_CELL cells, each cell also has a neighbour mask, bit
+  (level * NB_DIR + d) being set if the move in direction d is allowed from
+  that cell at that level. Above, the mask is computed from the kinds of the
+  neighbours with g_rule, on every call.
+The level after a move is level ^ g_flip[kind]. The engines only go through
+mazeCell(), mazeStep(), mazeState(), mazeMoves(), mazeNext() and mazePred().
+*/
+#define MAZE_BLOCK_LOG     4
+#define MAZE_BLOCK         (1 << MAZE_BLOCK_LOG)
+#define MAZE_BLOCK_MASK    (MAZE_BLOCK - 1)
+#ifndef MAZE_MAX_NBR_CELL
+#define MAZE_MAX_NBR_CELL  (1 << 28)  // 256MB of masks
+#endif
+#define MAZE_MAX_CELL      (INT_MAX - MAZE_BLOCK * MAZE_BLOCK + 1)
+
+struct Maze
+{
+    int     w, h;           // size of the map
+    int     nbBlockX;       // blocks per row of blocks
+    int     nbCell;         // padded grid
+    uint8_t *packed;        // tile kind of each cell, 4 bits each
+    uint8_t *nbr;           // move mask of each cell, or NULL
+};
+
+static inline int mazeCell(const struct Maze *m, int x, int y)
+{
+    x++;
+    y++;
+    return (((y >> MAZE_BLOCK_LOG) * m->nbBlockX + (x >> MAZE_BLOCK_LOG))
+            << (2 * MAZE_BLOCK_LOG)) |
+           ((y & MAZE_BLOCK_MASK) << MAZE_BLOCK_LOG) | (x & MAZE_BLOCK_MASK);
+}
+
+static inline int mazeX(const struct Maze *m, int cell)
+{
+    return ((cell >> (2 * MAZE_BLOCK_LOG)) % m->nbBlockX) * MAZE_BLOCK +
+           (cell & MAZE_BLOCK_MASK) - 1;
+}
+
+static inline int mazeY(const struct Maze *m, int cell)
+{
+    return ((cell >> (2 * MAZE_BLOCK_LOG)) / m->nbBlockX) * MAZE_BLOCK +
+           ((cell >> MAZE_BLOCK_LOG) & MAZE_BLOCK_MASK) - 1;
+}
+
+// Neighbour cell in direction d, crossing to the next block on its edges
+static inline int mazeStep(const struct Maze *m, int cell, int d)
+{
+    const int blockSize = MAZE_BLOCK * MAZE_BLOCK;
+    int lx = cell & MAZE_BLOCK_MASK;
+    int ly = (cell >> MAZE_BLOCK_LOG) & MAZE_BLOCK_MASK;
+
+    switch (d)
+    {
+    case DIR_L:
+        return lx > 0 ? cell - 1 : cell - blockSize + MAZE_BLOCK_MASK;
+    case DIR_R:
+        return lx < MAZE_BLOCK_MASK ? cell + 1 : cell + blockSize - MAZE_BLOCK_MASK;
+    case DIR_U:
+        return ly > 0 ? cell - MAZE_BLOCK :
+               cell - m->nbBlockX * blockSize + MAZE_BLOCK_MASK * MAZE_BLOCK;
+    default:
+        return ly < MAZE_BLOCK_MASK ? cell + MAZE_BLOCK :
+               cell + m->nbBlockX * blockSize - MAZE_BLOCK_MASK * MAZE_BLOCK;
+    }
+}
+
+static inline int mazeKind(const struct Maze *m, int cell)
+{
+    return (m->packed[cell >> 1] >> ((cell & 1) * 4)) & 0xf;
+}
+
+static inline void mazeSetKind(struct Maze *m, int cell, int kind)
+{
+    int shift = (cell & 1) * 4;
+    m->packed[cell >> 1] = (m->packed[cell >> 1] & ~(0xf << shift)) | (kind << shift);
+}
+
+static unsigned mazeComputeNbr(const struct Maze *m, int cell)
+{
+    int kind = mazeKind(m, cell);
+    unsigned nbr = 0;
+    int d, l;
+
+    // The padding may be on the edge of the grid
+    if (kind == TILE_PAD)
+        return 0;
+    for (d = 0; d < NB_DIR; d++)
+    {
+        int nkind = mazeKind(m, mazeStep(m, cell, d));
+        for (l = 0; l < NB_LEVEL; l++)
+            if (g_rule[kind][nkind][d][l] >= 0)
+                nbr |= 1 << (l * NB_DIR + d);
+    }
+    return nbr;
+}
+
+// Allocate a w x h maze, to be filled with mazeSetRow() then mazeBuildMoves()
+static int mazeInit(struct Maze *m, int w, int h)
+{
+    int64_t nbBlockX = ((int64_t)w + 2 + MAZE_BLOCK_MASK) >> MAZE_BLOCK_LOG;
+    int64_t nbCell = nbBlockX * (((int64_t)h + 2 + MAZE_BLOCK_MASK) >> MAZE_BLOCK_LOG) *
+                     MAZE_BLOCK * MAZE_BLOCK;
+
+    m->packed = m->nbr = NULL;
+    if (nbCell > MAZE_MAX_CELL)
+    {
+        fprintf(stderr, "Maze too big: %lld cells with the padding, at most %d\n",
+                (long long)nbCell, MAZE_MAX_CELL);
+        return -1;
+    }
+    m->w = w;
+    m->h = h;
+    m->nbBlockX = nbBlockX;
+    m->nbCell = nbCell;
+    m->packed = malloc(m->nbCell / 2);
+    if (m->packed == NULL)
+        return -1;
+    memset(m->packed, TILE_PAD * 0x11, m->nbCell / 2);
+    return 0;
+}
+
+// Set the w tiles of row y, as in the input
+static void mazeSetRow(struct Maze *m, int y, const char *row)
+{
+    int x, cell = mazeCell(m, 0, y);
+
+    for (x = 0; x < m->w; x++, cell = mazeStep(m, cell, DIR_R))
+        mazeSetKind(m, cell, g_tileOf[(unsigned char)row[x]]);
+}
+
+static int mazeBuildMoves(struct Maze *m)
+{
+    int x, y;
+
+    if (m->nbCell > MAZE_MAX_NBR_CELL)
+        return 0;
+    m->nbr = calloc(m->nbCell, 1);
+    if (m->nbr == NULL)
+        return -1;
+    for (y = 0; y < m->h; y++)
+        for (x = 0; x < m->w; x++)
+            m->nbr[mazeCell(m, x, y)] = mazeComputeNbr(m, mazeCell(m, x, y));
     return 0;
 }
 
+// Change the tile at (x, y), and the moves from it and onto it
+static void mazeSetTile(struct Maze *m, int x, int y, char c)
+{
+    int cell = mazeCell(m, x, y), d;
+
+    mazeSetKind(m, cell, g_tileOf[(unsigned char)c]);
+    if (m->nbr == NULL)
+        return;
+    m->nbr[cell] = mazeComputeNbr(m, cell);
+    for (d = 0; d < NB_DIR; d++)
+        m->nbr[mazeStep(m, cell, d)] = mazeComputeNbr(m, mazeStep(m, cell, d));
+}
+
+static void mazeFree(struct Maze *m)
+{
+    free(m->packed);
+    free(m->nbr);
+}
+
+/*
+A state of the engines is a cell, a level and a way: on a slope, the way it
+was entered, 0 going left or up and 1 going right or down, that is d & 1.
+A slope is only left the way it was entered: going back is stepping on the
+path, which the tree search refuses. Other cells are entered at way 0. The
+start was not entered, so it is searched from both ways at level 0: on
+other cells, way 1 moves as way 0 does.
+This gives the tree search's lengths, but when the shortest route steps on
+a cell again at the other level: the tree search only allows it on a bridge
+not entered from a slope, which needs the path, and a state does not have it.
+States are numbered in a long: cells fit an int, 4 times as many states do not.
+*/
+#define NB_WAY          2
+#define NB_CELL_STATE   (NB_LEVEL * NB_WAY)
+#define WAY_DIRS(way)   ((way) ? (1 << DIR_R | 1 << DIR_D) : (1 << DIR_L | 1 << DIR_U))
+
+static inline long mazeState(int cell, int level, int way)
+{
+    return ((long)cell * NB_WAY + way) * NB_LEVEL + level;
+}
+
+static inline int stateCell(long s)
+{
+    return s / NB_CELL_STATE;
+}
+
+static inline int stateLevel(long s)
+{
+    return s % NB_LEVEL;
+}
+
+static inline int stateWay(long s)
+{
+    return (s / NB_LEVEL) % NB_WAY;
+}
+
+// Allowed directions from a state, as a NB_DIR bits mask
+static inline unsigned mazeMoves(const struct Maze *m, long s)
+{
+    int cell = stateCell(s);
+    unsigned nbr = m->nbr != NULL ? m->nbr[cell] : mazeComputeNbr(m, cell);
+    unsigned moves = (nbr >> (stateLevel(s) * NB_DIR)) & ((1 << NB_DIR) - 1);
+
+    if (g_flip[mazeKind(m, cell)])
+        moves &= WAY_DIRS(stateWay(s));
+    return moves;
+}
+
+// State after the move in direction d from s, which must be allowed
+static inline long mazeNext(const struct Maze *m, long s, int d)
+{
+    int cell = stateCell(s);
+    int ncell = mazeStep(m, cell, d);
+
+    return mazeState(ncell, stateLevel(s) ^ g_flip[mazeKind(m, cell)],
+                     g_flip[mazeKind(m, ncell)] ? d & 1 : 0);
+}
+
+/*
+State from which the move in direction d leads to s, or -1: the previous
+cell must allow d at the level that leaving it turns into the level of s,
+which is that level ^ g_flip of that cell, and if it is a slope at the way
+of d. Nothing leads to a high wall or to the padding, whose neighbours may
+be past the grid.
+*/
+static inline long mazePred(const struct Maze *m, long s, int d)
+{
+    int kind = mazeKind(m, stateCell(s));
+
+    if (kind == TILE_HIGH || kind == TILE_PAD)
+        return -1;
+    if (stateWay(s) != (g_flip[kind] ? d & 1 : 0))
+        return -1;
+    int pcell = mazeStep(m, stateCell(s), d ^ 1);
+    int pkind = mazeKind(m, pcell);
+    long ps = mazeState(pcell, stateLevel(s) ^ g_flip[pkind], g_flip[pkind] ? d & 1 : 0);
+    if (!(mazeMoves(m, ps) & (1 << d)))
+        return -1;
+    return ps;
+}
+
+/*
+The tree search does not step on its start cell again, but for a bridge
+start, crossed at level 1 from a cell that is not a slope: coming from a
+slope, it checks the level before the move. Return 1 if the move from s to
+ns is one of those it refuses.
+*/
+static inline int mazeBackToStart(const struct Maze *m, long s, long ns, int startCell)
+{
+    return stateCell(ns) == startCell &&
+           (mazeKind(m, startCell) != TILE_BRIDGE || stateLevel(ns) == 0 ||
+            g_flip[mazeKind(m, stateCell(s))]);
+}
+
 static void initMazeTree(struct MazeNode *treeMaze,
                          const char *maze, int x, int y, int w)
 {
@@ -84,21 +501,30 @@ static void initMazeTree(struct MazeNode *treeMaze,
 }
 
 static void buildMazeTree(struct MazeNode *treeMaze,
-                          const char *maze, int w, int h)
+                          const char *maze, int w, int h, uint64_t *onPath)
 {
-    int d;
+    int d, wasOnPath;
+    long key = (long)(treeMaze->x + treeMaze->y * w) * NB_LEVEL;
     //fprintf(stderr, "buildMazeTree(%d %d '%c' %d)\n", treeMaze->x, treeMaze->y, treeMaze->c, treeMaze->level);
+
+    // Mark this node on the path, it is unmarked when leaving
+    if (treeMaze->c == 'X')
+    {
+        key += treeMaze->level;
+        wasOnPath = bitTest(onPath, key);
+        bitSet(onPath, key);
+    }
+    else
+    {
+        wasOnPath = 0;
+        bitSet(onPath, key);
+        bitSet(onPath, key + 1);
+    }
+
     for (d = 0; d < NB_DIR; d++)
     {
-        int nx, ny, ret;
-        
-        // Cannot go L/R on vertical slope
-        if (treeMaze->c == '|' && (d == DIR_L || d == DIR_R))
-            continue;
-        // Cannot go U/D on horizontal slope
-        if (treeMaze->c == '-' && (d == DIR_U || d == DIR_D))
-            continue;
-        
+        int nx, ny, nlevel, ret;
+
         ret = goDir(&nx, &ny, treeMaze->x, treeMaze->y, d, w, h);
         
         // If cannot move, next direction
@@ -106,51 +532,12 @@ static void buildMazeTree(struct MazeNode *treeMaze,
             continue;
             
         // Don't step back
-        if (checkStepBack(treeMaze, nx, ny, treeMaze->level) != 0)
-            continue;
-        
-        // Cannot go on high wall
-        if (maze[nx + ny * w] == '#')
-            continue;
-        
-        // If on the floor...
-        if (treeMaze->c == '.')
-        {
-            // Cannot go straight on short wall
-            if (maze[nx + ny * w] == '+')
-                continue;
-        }
-
-        // If on a short wall...
-        if (treeMaze->c == '+')
-        {
-            // Cannot go straight on the floor
-            if (maze[nx + ny * w] == '.')
-                continue;
-        }
-
-        // Cannot cross slopes
-        if (maze[nx + ny * w] == '|' && (d == DIR_L || d == DIR_R))
-            continue;
-        if (maze[nx + ny * w] == '-' && (d == DIR_U || d == DIR_D))
+        if (checkOnPath(onPath, maze[nx + ny * w], nx + ny * w, treeMaze->level) != 0)
             continue;
 
-        // A level 1 slope cannot lead to another short wall (different level of short walls not permitted)
-        if ((treeMaze->c == '|' || treeMaze->c == '-') &&
-            treeMaze->level == 1 &&
-            maze[nx + ny * w] == '+')
-            continue;
-        // A level 0 slope cannot lead to another floor (different level of floors not permitted)
-        if ((treeMaze->c == '|' || treeMaze->c == '-') &&
-            treeMaze->level == 0 &&
-            maze[nx + ny * w] == '.')
-            continue;
-
-        // Level 0 bridges cannot lead to shorts walls
-        if (treeMaze->c == 'X' && treeMaze->level == 0 && maze[nx + ny * w] == '+')
-            continue;
-        // Level 1 bridges cannot lead to floors
-        if (treeMaze->c == 'X' && treeMaze->level == 1 && maze[nx + ny * w] == '.')
+        nlevel = g_rule[g_tileOf[(unsigned char)treeMaze->c]]
+                       [g_tileOf[(unsigned char)maze[nx + ny * w]]][d][treeMaze->level];
+        if (nlevel < 0)
             continue;
 
         // We can go in that direction now!
@@ -160,13 +547,15 @@ static void buildMazeTree(struct MazeNode *treeMaze,
         treeMaze->next[d]->x = nx;
         treeMaze->next[d]->y = ny;
         treeMaze->next[d]->prev = treeMaze;
-        if (treeMaze->c == '|' || treeMaze->c == '-')
-            treeMaze->next[d]->level = 1 - treeMaze->level;
-        else
-            treeMaze->next[d]->level = treeMaze->level;
+        treeMaze->next[d]->level = nlevel;
         
-        buildMazeTree(treeMaze->next[d], maze, w, h);
+        buildMazeTree(treeMaze->next[d], maze, w, h, onPath);
     }
+
+    if (!wasOnPath)
+        bitClear(onPath, key);
+    if (treeMaze->c != 'X')
+        bitClear(onPath, key + 1);
 }
 
 static int travelMazeTree(struct MazeNode *treeMaze, int n, int endx, int endy)
@@ -192,41 +581,1402 @@ static int travelMazeTree(struct MazeNode *treeMaze, int n, int endx, int endy)
     return maxN;
 }
 
-// To debug: fprintf(stderr, "Debug messages...\n");
-int main()
+/************************************ BFS *************************************/
+/*
+Breadth-first search over the (x, y, level, way) states of mazeState(), with
+the rules of stepRule(). Each state is visited once, so it is O(w * h) in
+time, and it gives the tree search's length but in the cases above. Besides
+a bit per state, only the current depth and the next one are stored, which
+keeps 10^9 cells within a few GB on mazes whose layers are not huge.
+*/
+
+#define NO_PATH  (1 << 30)  // what travelMazeTree() returns without exit
+
+// Per query statistics, to compare the engines on a map
+struct SearchStat
 {
-    // Parse input
-    int starty;
-    int startx;
-    scanf("%d%d", &starty, &startx);
-    int endy;
-    int endx;
-    scanf("%d%d", &endy, &endx);
-    int h;
-    int w;
-    scanf("%d%d", &h, &w);
-
-    fprintf(stderr, "start=(%d %d) end=(%d %d) size=(%d %d)\n",
-            startx, starty, endx, endy, w, h);
-
-    char* maze = malloc(h * w * sizeof(char));
-    for (int i = 0; i < h; i++)
+    long   expanded;    // nb of states whose moves were looked at
+    double ms;          // time spent in the query
+};
+
+// Growing array of states
+struct Stack
+{
+    long *item;
+    long len, size;
+};
+
+static int stackPush(struct Stack *stack, long item)
+{
+    if (stack->len == stack->size)
     {
-        scanf("%s", &maze[i * w]);
-        int j;
-        for (j = 0; j < w; j++)
-            fprintf(stderr, "%c", maze[i * w + j]);
-        fprintf(stderr, "\n");
+        long size = stack->size ? stack->size * 2 : 1024;
+        long *p = realloc(stack->item, size * sizeof(long));
+        if (p == NULL)
+            return -1;
+        stack->item = p;
+        stack->size = size;
+    }
+    stack->item[stack->len++] = item;
+    return 0;
+}
+
+static int bfsMaze(const struct Maze *m, int startx, int starty,
+                   int endx, int endy, struct SearchStat *stat)
+{
+    long nbState = (long)m->nbCell * NB_CELL_STATE;
+    int startCell = mazeCell(m, startx, starty);
+    int endCell = mazeCell(m, endx, endy);
+    uint64_t *visited = bitsetAlloc(nbState);
+    struct Stack layer[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+    int cur = 0, depth = 0, ret = NO_PATH, way;
+    long i;
+
+    if (visited == NULL)
+        return -1;
+
+    if (startx == endx && starty == endy)
+        ret = 0;
+
+    for (way = 0; way < NB_WAY; way++)
+    {
+        bitSet(visited, mazeState(startCell, 0, way));
+        if (stackPush(&layer[cur], mazeState(startCell, 0, way)) != 0)
+            ret = -1;
+    }
+
+    // Only the current depth and the next one are kept
+    while (layer[cur].len > 0 && ret == NO_PATH)
+    {
+        struct Stack *next = &layer[1 - cur];
+        depth++;
+        next->len = 0;
+        for (i = 0; i < layer[cur].len && ret == NO_PATH; i++)
+        {
+            long s = layer[cur].item[i];
+            unsigned moves = mazeMoves(m, s);
+            stat->expanded++;
+
+            for (; moves != 0; moves &= moves - 1)
+            {
+                long ns = mazeNext(m, s, __builtin_ctz(moves));
+                if (bitTest(visited, ns) || mazeBackToStart(m, s, ns, startCell))
+                    continue;
+                bitSet(visited, ns);
+                if (stateCell(ns) == endCell)
+                {
+                    ret = depth;
+                    break;
+                }
+                if (stackPush(next, ns) != 0)
+                {
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+        cur = 1 - cur;
+    }
+
+    free(visited);
+    free(layer[0].item);
+    free(layer[1].item);
+    return ret;
+}
+
+/*********************************** ASTAR ************************************/
+/*
+A* with the Manhattan distance to the exit as heuristic: a move changes it
+by one whatever the levels, so it never overestimates. With unit moves, f
+grows by 0 or 2 along any move, so the open list is two buckets: f (popped
+last in, first out, which goes deep towards the exit) and f + 2. A state is
+pushed again only when its g improves, which changes its f; entries whose f
+no longer matches their bucket are stale and skipped.
+*/
+
+static int astarMaze(const struct Maze *m, int startx, int starty,
+                     int endx, int endy, struct SearchStat *stat)
+{
+    long nbState = (long)m->nbCell * NB_CELL_STATE;
+    int startCell = mazeCell(m, startx, starty);
+    int endCell = mazeCell(m, endx, endy);
+    int *g = malloc(nbState * sizeof(int));
+    struct Stack bucket[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+    int cur = 0, f, ret = NO_PATH, way;
+
+    if (g == NULL)
+        return -1;
+    memset(g, 0x7f, nbState * sizeof(int));
+
+    #define HEURISTIC(cell) (abs(mazeX(m, cell) - endx) + abs(mazeY(m, cell) - endy))
+
+    f = abs(startx - endx) + abs(starty - endy);
+    for (way = 0; way < NB_WAY; way++)
+    {
+        long s = mazeState(startCell, 0, way);
+        g[s] = 0;
+        stackPush(&bucket[cur], s);
     }
-    
-    struct MazeNode treeMaze;
-    initMazeTree(&treeMaze, maze, startx, starty, w);
-    buildMazeTree(&treeMaze, maze, w, h);
-    
-    int n;
-    n = travelMazeTree(&treeMaze, 0, endx, endy);
 
-    printf("%d\n", n);
+    while (ret == NO_PATH && (bucket[cur].len > 0 || bucket[1 - cur].len > 0))
+    {
+        if (bucket[cur].len == 0)
+        {
+            cur = 1 - cur;
+            f += 2;
+            continue;
+        }
+
+        long s = bucket[cur].item[--bucket[cur].len];
+        int cell = stateCell(s);
+        if (g[s] + HEURISTIC(cell) != f)
+            continue;
+        if (cell == endCell)
+        {
+            ret = g[s];
+            break;
+        }
+        stat->expanded++;
+
+        unsigned moves = mazeMoves(m, s);
+        for (; moves != 0; moves &= moves - 1)
+        {
+            long ns = mazeNext(m, s, __builtin_ctz(moves));
+            int ncell = stateCell(ns);
+            if (g[ns] <= g[s] + 1 || mazeBackToStart(m, s, ns, startCell))
+                continue;
+            g[ns] = g[s] + 1;
+            // f is kept if getting closer, else it grows by 2
+            if (stackPush(&bucket[HEURISTIC(ncell) < HEURISTIC(cell) ? cur : 1 - cur], ns) != 0)
+                ret = -1;
+        }
+    }
+    #undef HEURISTIC
+
+    free(g);
+    free(bucket[0].item);
+    free(bucket[1].item);
+    return ret;
+}
+
+/*********************************** BIBFS ************************************/
+/*
+Bidirectional BFS: one search forward from the start, one backward from all
+the states of the exit, expanding in turn a whole layer of the smaller
+frontier. The backward one follows the moves in reverse, with mazePred().
+The first layer that meets the other search holds the shortest path, the
+best meeting of that layer is kept.
+*/
 
+struct Frontier
+{
+    int  *dist;     // depth of each state, -1 if not reached
+    long *queue;
+    long head, tail;
+    int  depth;
+};
+
+static int frontierInit(struct Frontier *fr, long nbState)
+{
+    fr->dist  = malloc(nbState * sizeof(int));
+    fr->queue = malloc(nbState * sizeof(long));
+    fr->head = fr->tail = fr->depth = 0;
+    if (fr->dist == NULL || fr->queue == NULL)
+        return -1;
+    memset(fr->dist, 0xff, nbState * sizeof(int));
     return 0;
 }
+
+static void frontierFree(struct Frontier *fr)
+{
+    free(fr->dist);
+    free(fr->queue);
+}
+
+static void frontierAdd(struct Frontier *fr, long s, int dist)
+{
+    fr->dist[s] = dist;
+    fr->queue[fr->tail++] = s;
+}
+
+// Expand a layer; return the shortest path through it, or NO_PATH
+static int frontierExpand(const struct Maze *m, struct Frontier *fr,
+                          const struct Frontier *other, int backward,
+                          int startCell, struct SearchStat *stat)
+{
+    long layerEnd = fr->tail;
+    int best = NO_PATH;
+
+    fr->depth++;
+    for (; fr->head < layerEnd; fr->head++)
+    {
+        long s = fr->queue[fr->head];
+        int d;
+        stat->expanded++;
+
+        for (d = 0; d < NB_DIR; d++)
+        {
+            long ns;
+            if (!backward)
+            {
+                if (!(mazeMoves(m, s) & (1 << d)))
+                    continue;
+                ns = mazeNext(m, s, d);
+                if (mazeBackToStart(m, s, ns, startCell))
+                    continue;
+            }
+            else
+            {
+                ns = mazePred(m, s, d);
+                if (ns < 0 || mazeBackToStart(m, ns, s, startCell))
+                    continue;
+            }
+            if (fr->dist[ns] >= 0)
+                continue;
+            frontierAdd(fr, ns, fr->depth);
+            if (other->dist[ns] >= 0 && fr->depth + other->dist[ns] < best)
+                best = fr->depth + other->dist[ns];
+        }
+    }
+    return best;
+}
+
+static int bibfsMaze(const struct Maze *m, int startx, int starty,
+                     int endx, int endy, struct SearchStat *stat)
+{
+    long nbState = (long)m->nbCell * NB_CELL_STATE;
+    int start = mazeCell(m, startx, starty);
+    long end = mazeState(mazeCell(m, endx, endy), 0, 0);
+    struct Frontier fw, bw;
+    int l, ret = NO_PATH;
+
+    if (startx == endx && starty == endy)
+        return 0;
+    if (frontierInit(&fw, nbState) != 0 || frontierInit(&bw, nbState) != 0)
+    {
+        frontierFree(&fw);
+        frontierFree(&bw);
+        return -1;
+    }
+
+    for (l = 0; l < NB_WAY; l++)
+        frontierAdd(&fw, mazeState(start, 0, l), 0);
+    for (l = 0; l < NB_CELL_STATE; l++)
+        frontierAdd(&bw, end + l, 0);
+
+    while (ret == NO_PATH && fw.head < fw.tail && bw.head < bw.tail)
+    {
+        if (fw.tail - fw.head <= bw.tail - bw.head)
+            ret = frontierExpand(m, &fw, &bw, 0, start, stat);
+        else
+            ret = frontierExpand(m, &bw, &fw, 1, start, stat);
+    }
+
+    frontierFree(&fw);
+    frontierFree(&bw);
+    return ret;
+}
+
+/********************************** PARALLEL **********************************/
+/*
+Level-synchronous parallel BFS, for mazes of 10^7 cells and more (build with
+-pthread). Every thread expands its share of the current layer into its own
+buffer; the buffers are then concatenated into the next layer. The visited
+bitmap is shared and set with atomic ORs, the thread that sets a bit owns
+the state. As in direction-optimizing BFS, the big middle layers are done
+bottom-up: each thread goes over its range of unvisited states and looks for
+a predecessor in the current layer, kept as a bitmap for that purpose. The
+layers are the same as the serial BFS's, hence the same distances.
+*/
+
+#define PAR_BOTTOM_UP_ON  20    // bottom-up when the layer is > states / 20
+#define PAR_BOTTOM_UP_OFF 100   // top-down again when it is < states / 100
+
+struct ParBfs;
+
+struct ParWorker
+{
+    struct ParBfs *bfs;
+    pthread_t     thread;
+    int           id;
+    struct Stack  buf;      // states found by this thread in the step
+    long          offset;   // where they go in the next layer
+    long          expanded;
+};
+
+struct ParBfs
+{
+    const struct Maze *m;
+    int               nbThread, startCell, endCell;
+    long              nbState;
+    uint64_t          *visited;
+    uint64_t          *layerBits;   // current layer, for bottom-up steps
+    long              *layer, layerLen;
+    int               bottomUp;
+    int               depth, found, done;
+    pthread_mutex_t   start;    // held until all the threads are created
+    pthread_barrier_t barrier;
+    struct ParWorker  *worker;
+};
+
+static inline int parTestAndSet(uint64_t *bits, long i)
+{
+    uint64_t mask = 1ull << (i & 63);
+    if (__atomic_load_n(&bits[i >> 6], __ATOMIC_RELAXED) & mask)
+        return 1;
+    return (__atomic_fetch_or(&bits[i >> 6], mask, __ATOMIC_RELAXED) & mask) != 0;
+}
+
+static void parFound(struct ParWorker *wk, long ns)
+{
+    stackPush(&wk->buf, ns);
+    if (stateCell(ns) == wk->bfs->endCell)
+        __atomic_store_n(&wk->bfs->found, 1, __ATOMIC_RELAXED);
+}
+
+static void parTopDown(struct ParWorker *wk)
+{
+    struct ParBfs *bfs = wk->bfs;
+    const struct Maze *m = bfs->m;
+    long from = bfs->layerLen * wk->id / bfs->nbThread;
+    long to = bfs->layerLen * (wk->id + 1) / bfs->nbThread;
+    long i;
+
+    for (i = from; i < to; i++)
+    {
+        long s = bfs->layer[i];
+        unsigned moves = mazeMoves(m, s);
+        wk->expanded++;
+
+        for (; moves != 0; moves &= moves - 1)
+        {
+            long ns = mazeNext(m, s, __builtin_ctz(moves));
+            if (!mazeBackToStart(m, s, ns, bfs->startCell) &&
+                !parTestAndSet(bfs->visited, ns))
+                parFound(wk, ns);
+        }
+    }
+}
+
+static void parBottomUp(struct ParWorker *wk)
+{
+    struct ParBfs *bfs = wk->bfs;
+    const struct Maze *m = bfs->m;
+    // Ranges are whole words, so that no other thread sets these bits
+    long nbWord = (bfs->nbState + 63) / 64;
+    long from = nbWord * wk->id / bfs->nbThread * 64;
+    long to = nbWord * (wk->id + 1) / bfs->nbThread * 64;
+    long s;
+    int d;
+
+    if (to > bfs->nbState)
+        to = bfs->nbState;
+    for (s = from; s < to; s++)
+    {
+        if (__atomic_load_n(&bfs->visited[s >> 6], __ATOMIC_RELAXED) & (1ull << (s & 63)))
+            continue;
+        wk->expanded++;
+        for (d = 0; d < NB_DIR; d++)
+        {
+            long ps = mazePred(m, s, d);
+            if (ps >= 0 && bitTest(bfs->layerBits, ps) &&
+                !mazeBackToStart(m, ps, s, bfs->startCell))
+            {
+                parTestAndSet(bfs->visited, s);
+                parFound(wk, s);
+                break;
+            }
+        }
+    }
+}
+
+static void *parWork(void *arg)
+{
+    struct ParWorker *wk = arg;
+    struct ParBfs *bfs = wk->bfs;
+    int i;
+
+    pthread_mutex_lock(&bfs->start);
+    pthread_mutex_unlock(&bfs->start);
+    while (!bfs->done)
+    {
+        if (bfs->bottomUp)
+            parBottomUp(wk);
+        else
+            parTopDown(wk);
+        pthread_barrier_wait(&bfs->barrier);
+
+        // One thread lays out the next layer and picks its direction
+        if (wk->id == 0)
+        {
+            long len = 0;
+            for (i = 0; i < bfs->nbThread; i++)
+            {
+                bfs->worker[i].offset = len;
+                len += bfs->worker[i].buf.len;
+            }
+            bfs->depth++;
+            bfs->layerLen = len;
+            bfs->done = bfs->found || len == 0;
+            if (!bfs->bottomUp && len > bfs->nbState / PAR_BOTTOM_UP_ON)
+                bfs->bottomUp = 1;
+            else if (bfs->bottomUp && len < bfs->nbState / PAR_BOTTOM_UP_OFF)
+                bfs->bottomUp = 0;
+            if (bfs->bottomUp)
+                memset(bfs->layerBits, 0x0, (bfs->nbState + 63) / 64 * sizeof(uint64_t));
+        }
+        pthread_barrier_wait(&bfs->barrier);
+        if (bfs->done)
+            break;
+
+        memcpy(bfs->layer + wk->offset, wk->buf.item, wk->buf.len * sizeof(long));
+        if (bfs->bottomUp)
+            for (i = 0; i < wk->buf.len; i++)
+                parTestAndSet(bfs->layerBits, wk->buf.item[i]);
+        wk->buf.len = 0;
+        pthread_barrier_wait(&bfs->barrier);
+    }
+    return NULL;
+}
+
+static int parbfsMaze(const struct Maze *m, int startx, int starty,
+                      int endx, int endy, int nbThread, struct SearchStat *stat)
+{
+    struct ParBfs bfs;
+    int i, barrier, ret = -1;
+
+    if (startx == endx && starty == endy)
+        return 0;
+    if (nbThread < 1)
+        nbThread = 1;
+
+    memset(&bfs, 0x0, sizeof(struct ParBfs));
+    bfs.m = m;
+    bfs.nbThread = nbThread;
+    bfs.nbState = (long)m->nbCell * NB_CELL_STATE;
+    bfs.startCell = mazeCell(m, startx, starty);
+    bfs.endCell = mazeCell(m, endx, endy);
+    bfs.visited = bitsetAlloc(bfs.nbState);
+    bfs.layerBits = bitsetAlloc(bfs.nbState);
+    bfs.layer = malloc(bfs.nbState * sizeof(long));
+    bfs.worker = calloc(nbThread, sizeof(struct ParWorker));
+    if (bfs.visited == NULL || bfs.layerBits == NULL ||
+        bfs.layer == NULL || bfs.worker == NULL)
+        goto out;
+
+    for (i = 0; i < NB_WAY; i++)
+    {
+        bfs.layer[bfs.layerLen] = mazeState(bfs.startCell, 0, i);
+        bitSet(bfs.visited, bfs.layer[bfs.layerLen++]);
+    }
+
+    // The barrier is sized once the threads that could start are known
+    pthread_mutex_init(&bfs.start, NULL);
+    pthread_mutex_lock(&bfs.start);
+    bfs.worker[0].bfs = &bfs;
+    for (i = 1; i < nbThread; i++)
+    {
+        bfs.worker[i].bfs = &bfs;
+        bfs.worker[i].id = i;
+        if (pthread_create(&bfs.worker[i].thread, NULL, parWork, &bfs.worker[i]) != 0)
+        {
+            fprintf(stderr, "Only %d threads started\n", i);
+            break;
+        }
+    }
+    bfs.nbThread = i;
+    barrier = pthread_barrier_init(&bfs.barrier, NULL, bfs.nbThread) == 0;
+    bfs.done = !barrier;
+    pthread_mutex_unlock(&bfs.start);
+
+    parWork(&bfs.worker[0]);
+    for (i = 0; i < bfs.nbThread; i++)
+    {
+        if (i > 0)
+            pthread_join(bfs.worker[i].thread, NULL);
+        stat->expanded += bfs.worker[i].expanded;
+        free(bfs.worker[i].buf.item);
+    }
+    pthread_mutex_destroy(&bfs.start);
+    if (barrier)
+    {
+        pthread_barrier_destroy(&bfs.barrier);
+        ret = bfs.found ? bfs.depth : NO_PATH;
+    }
+
+out:
+    free(bfs.visited);
+    free(bfs.layerBits);
+    free(bfs.layer);
+    free(bfs.worker);
+    return ret;
+}
+
+/************************************ PATH ************************************/
+/*
+Path reconstruction. The BFS runs backward, from all the states of the
+exit, and keeps the direction of the move towards the exit of each state
+found. A slope is left the way it was entered, so that direction is the only
+move of its states; the other cells only have way 0. Hence 2 bits per cell
+and level, a quarter of a byte per cell, plus the half byte of the visited
+bitset and the two layers of the BFS. The path is then followed from the
+start and each move is written as it is found, without materializing the
+route.
+*/
+
+static const char *strDir[NB_DIR] = {"LEFT", "RIGHT", "UP", "DOWN"};
+
+static inline int dir2Get(const uint8_t *dirs, long i)
+{
+    return (dirs[i >> 2] >> ((i & 3) * 2)) & 3;
+}
+
+static inline void dir2Set(uint8_t *dirs, long i, int d)
+{
+    dirs[i >> 2] = (dirs[i >> 2] & ~(3 << ((i & 3) * 2))) | (d << ((i & 3) * 2));
+}
+
+// Direction of the move towards the exit from s, once found by pathMaze()
+static inline int pathDir(const struct Maze *m, const uint8_t *dirs, long s)
+{
+    if (g_flip[mazeKind(m, stateCell(s))])
+        return __builtin_ctz(mazeMoves(m, s));
+    return dir2Get(dirs, (long)stateCell(s) * NB_LEVEL + stateLevel(s));
+}
+
+// Print the length, then "<move> <level after it>" lines; return the length
+static int pathMaze(const struct Maze *m, int startx, int starty,
+                    int endx, int endy, FILE *out)
+{
+    long nbState = (long)m->nbCell * NB_CELL_STATE, start = -1, i;
+    int startCell = mazeCell(m, startx, starty);
+    int endCell = mazeCell(m, endx, endy);
+    uint64_t *visited = bitsetAlloc(nbState);
+    uint8_t *dirs = malloc(((long)m->nbCell * NB_LEVEL + 3) / 4);
+    struct Stack layer[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+    int cur = 0, depth = 0, ret = NO_PATH, l, d;
+
+    if (visited == NULL || dirs == NULL)
+    {
+        ret = -1;
+        goto out;
+    }
+
+    for (l = 0; l < NB_CELL_STATE; l++)
+    {
+        bitSet(visited, mazeState(endCell, 0, 0) + l);
+        if (stackPush(&layer[cur], mazeState(endCell, 0, 0) + l) != 0)
+            ret = -1;
+    }
+    if (startCell == endCell && ret != -1)
+        ret = 0;
+
+    while (layer[cur].len > 0 && ret == NO_PATH)
+    {
+        struct Stack *next = &layer[1 - cur];
+        depth++;
+        next->len = 0;
+        for (i = 0; i < layer[cur].len && ret == NO_PATH; i++)
+        {
+            long s = layer[cur].item[i];
+            for (d = 0; d < NB_DIR; d++)
+            {
+                long ps = mazePred(m, s, d);
+                if (ps < 0 || bitTest(visited, ps) || mazeBackToStart(m, ps, s, startCell))
+                    continue;
+                bitSet(visited, ps);
+                if (!g_flip[mazeKind(m, stateCell(ps))])
+                    dir2Set(dirs, (long)stateCell(ps) * NB_LEVEL + stateLevel(ps), d);
+                // any way of the start, at level 0
+                if (stateCell(ps) == startCell && stateLevel(ps) == 0)
+                {
+                    start = ps;
+                    ret = depth;
+                    break;
+                }
+                if (stackPush(next, ps) != 0)
+                {
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+        cur = 1 - cur;
+    }
+
+    fprintf(out, "%d\n", ret);
+    if (ret > 0 && ret != NO_PATH)
+    {
+        long s = start;
+        while (stateCell(s) != endCell)
+        {
+            d = pathDir(m, dirs, s);
+            s = mazeNext(m, s, d);
+            fprintf(out, "%s %d\n", strDir[d], stateLevel(s));
+        }
+    }
+
+out:
+    free(visited);
+    free(dirs);
+    free(layer[0].item);
+    free(layer[1].item);
+    return ret;
+}
+
+/*********************************** INPUT ************************************/
+/*
+A regular file is mapped whole, other inputs are read by blocks as they are
+needed, and scanned in place: rows are checked and packed straight from the
+buffer, which keeps the loading of big maps well below the search time. On a
+pipe, the queries and edits after the maze are answered as they come: stdout
+is flushed before any read that may block.
+*/
+
+#define INPUT_BLOCK (1 << 20)
+
+struct Input
+{
+    char   *buf;
+    size_t len, pos, size;
+    int    fd, mapped, eof;
+};
+
+static int inputOpen(struct Input *in, int fd)
+{
+    struct stat st;
+
+    memset(in, 0x0, sizeof(struct Input));
+    in->fd = fd;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        in->buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (in->buf != MAP_FAILED)
+        {
+            madvise(in->buf, st.st_size, MADV_SEQUENTIAL);
+            in->len = st.st_size;
+            in->mapped = in->eof = 1;
+            return 0;
+        }
+        in->buf = NULL;
+    }
+    return 0;
+}
+
+static void inputClose(struct Input *in)
+{
+    if (in->mapped)
+        munmap(in->buf, in->len);
+    else
+        free(in->buf);
+}
+
+// Have n bytes from pos in the buffer, or all that is left; -1 if fewer
+static int inputFill(struct Input *in, size_t n)
+{
+    while (in->len - in->pos < n && !in->eof)
+    {
+        ssize_t r;
+        if (in->pos > 0)
+        {
+            memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+            in->len -= in->pos;
+            in->pos = 0;
+        }
+        if (in->size < n || in->len == in->size)
+        {
+            size_t size = (n > in->size ? n : in->size) + INPUT_BLOCK;
+            char *p = realloc(in->buf, size);
+            if (p == NULL)
+                return -1;
+            in->buf = p;
+            in->size = size;
+        }
+        fflush(stdout);
+        r = read(in->fd, in->buf + in->len, in->size - in->len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            in->eof = 1;
+        else
+            in->len += r;
+    }
+    return in->len - in->pos >= n ? 0 : -1;
+}
+
+// Next character, not consumed, or -1 at the end
+static inline int inputPeek(struct Input *in)
+{
+    if (in->pos == in->len && inputFill(in, 1) != 0)
+        return -1;
+    return (unsigned char)in->buf[in->pos];
+}
+
+static inline int inputIsSpace(int c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static void inputSkipSpace(struct Input *in)
+{
+    while (inputIsSpace(inputPeek(in)))
+        in->pos++;
+}
+
+// Read a decimal integer; return -1 on EOF or if there is none
+static int inputInt(struct Input *in, int *v)
+{
+    int neg = 0, n = 0, c, digits = 0;
+
+    inputSkipSpace(in);
+    if (inputPeek(in) == '-')
+    {
+        neg = 1;
+        in->pos++;
+    }
+    while ((c = inputPeek(in)) >= '0' && c <= '9')
+    {
+        n = n * 10 + c - '0';
+        in->pos++;
+        digits++;
+    }
+    if (digits == 0)
+        return -1;
+    *v = neg ? -n : n;
+    return 0;
+}
+
+// Next word, which must be w characters long; NULL otherwise
+static const char *inputRow(struct Input *in, int w)
+{
+    const char *row;
+    int x;
+
+    inputSkipSpace(in);
+    // the row and the character after it, if any
+    inputFill(in, (size_t)w + 1);
+    if (in->len - in->pos < (size_t)w)
+        return NULL;
+    row = in->buf + in->pos;
+    for (x = 0; x < w; x++)
+        if (inputIsSpace(row[x]))
+            return NULL;
+    in->pos += w;
+    if (in->pos < in->len && !inputIsSpace(in->buf[in->pos]))
+        return NULL;
+    return row;
+}
+
+/*********************************** ROUTER ***********************************/
+/*
+Multi-query mode: the maze is loaded once and a router answers a stream of
+(start, end) queries. Its BFS buffers are allocated once, and a state is
+visited in the current query if its stamp equals the query generation, so
+nothing is cleared between queries.
+States are labelled by weakly connected component (the moves taken both
+ways): a start and an exit in different components cannot be linked, which
+is answered without any search. On small maps, the distances from each
+start state are also cached on first use, so that a start is searched once.
+*/
+
+#define ROUTER_MAX_CACHED_STATE 4096    // at most 32MB of cached distances
+#define ROUTER_UNREACHED        0xffff
+
+struct Router
+{
+    const struct Maze *m;
+    int      *comp;     // component of each state
+    uint32_t *stamp;    // visited in the current query if == gen
+    uint32_t gen;
+    long     *queue;
+    uint16_t **row;     // distances from each start state, NULL if not cached
+};
+
+static void routerLabel(struct Router *r)
+{
+    const struct Maze *m = r->m;
+    long nbState = (long)m->nbCell * NB_CELL_STATE, s;
+    int nbComp = 0;
+
+    memset(r->comp, 0xff, nbState * sizeof(int));
+    for (s = 0; s < nbState; s++)
+    {
+        long head = 0, tail = 0;
+        int kind = mazeKind(m, stateCell(s));
+        // way 1 is only a state of slopes, or of the start
+        if (r->comp[s] >= 0 || kind == TILE_PAD || (stateWay(s) && !g_flip[kind]))
+            continue;
+        r->comp[s] = nbComp;
+        r->queue[tail++] = s;
+        while (head < tail)
+        {
+            long cs = r->queue[head++], ns;
+            unsigned moves = mazeMoves(m, cs);
+            int d;
+
+            for (d = 0; d < NB_DIR; d++)
+            {
+                // Forward, then backward move
+                ns = moves & (1 << d) ? mazeNext(m, cs, d) : -1;
+                if (ns >= 0 && r->comp[ns] < 0)
+                {
+                    r->comp[ns] = nbComp;
+                    r->queue[tail++] = ns;
+                }
+                ns = mazePred(m, cs, d);
+                if (ns >= 0 && r->comp[ns] < 0)
+                {
+                    r->comp[ns] = nbComp;
+                    r->queue[tail++] = ns;
+                }
+            }
+        }
+        nbComp++;
+    }
+}
+
+static int routerInit(struct Router *r, const struct Maze *m, int cache)
+{
+    long nbState = (long)m->nbCell * NB_CELL_STATE;
+
+    memset(r, 0x0, sizeof(struct Router));
+    r->m = m;
+    // the components are numbered in an int
+    if (nbState > INT_MAX)
+    {
+        fprintf(stderr, "Too many states for -q: %ld\n", nbState);
+        return -1;
+    }
+    r->comp  = malloc(nbState * sizeof(int));
+    r->stamp = calloc(nbState, sizeof(uint32_t));
+    r->queue = malloc(nbState * sizeof(long));
+    if (cache && nbState <= ROUTER_MAX_CACHED_STATE)
+        r->row = calloc(nbState, sizeof(uint16_t *));
+    if (r->comp == NULL || r->stamp == NULL || r->queue == NULL)
+        return -1;
+
+    routerLabel(r);
+    return 0;
+}
+
+static void routerFree(struct Router *r)
+{
+    long s;
+
+    if (r->row != NULL)
+        for (s = 0; s < (long)r->m->nbCell * NB_CELL_STATE; s++)
+            free(r->row[s]);
+    free(r->row);
+    free(r->comp);
+    free(r->stamp);
+    free(r->queue);
+}
+
+/*
+BFS from both ways of the start state, stopping on the first state of
+endCell, or going through the whole component when endCell is -1 and row
+is given to be filled.
+*/
+static int routerBfs(struct Router *r, long start, int endCell, uint16_t *row)
+{
+    const struct Maze *m = r->m;
+    long head = 0, tail = 0;
+    int depth = 0, way;
+
+    // On wrap-around, clear the stamps of the previous generations
+    if (++r->gen == 0)
+    {
+        memset(r->stamp, 0x0, (size_t)m->nbCell * NB_CELL_STATE * sizeof(uint32_t));
+        r->gen = 1;
+    }
+
+    for (way = 0; way < NB_WAY; way++)
+    {
+        long s = start + way * NB_LEVEL;
+        r->stamp[s] = r->gen;
+        r->queue[tail++] = s;
+        if (row != NULL)
+            row[s] = 0;
+    }
+
+    while (head < tail)
+    {
+        long layerEnd = tail;
+        depth++;
+        for (; head < layerEnd; head++)
+        {
+            long s = r->queue[head];
+            unsigned moves = mazeMoves(m, s);
+
+            for (; moves != 0; moves &= moves - 1)
+            {
+                long ns = mazeNext(m, s, __builtin_ctz(moves));
+                if (r->stamp[ns] == r->gen || mazeBackToStart(m, s, ns, stateCell(start)))
+                    continue;
+                r->stamp[ns] = r->gen;
+                if (row != NULL)
+                    row[ns] = depth;
+                if (stateCell(ns) == endCell)
+                    return depth;
+                r->queue[tail++] = ns;
+            }
+        }
+    }
+    return NO_PATH;
+}
+
+static int routerQuery(struct Router *r, int startx, int starty, int endx, int endy)
+{
+    const struct Maze *m = r->m;
+    long start, end;
+    int l, way, linked = 0;
+
+    if (startx < 0 || startx >= m->w || starty < 0 || starty >= m->h ||
+        endx < 0 || endx >= m->w || endy < 0 || endy >= m->h)
+        return -1;
+    if (startx == endx && starty == endy)
+        return 0;
+
+    start = mazeState(mazeCell(m, startx, starty), 0, 0);
+    end = mazeState(mazeCell(m, endx, endy), 0, 0);
+    for (way = 0; way < NB_WAY; way++)
+        for (l = 0; l < NB_CELL_STATE; l++)
+            if (r->comp[end + l] >= 0 && r->comp[start + way * NB_LEVEL] == r->comp[end + l])
+                linked = 1;
+    if (!linked)
+        return NO_PATH;
+
+    if (r->row == NULL)
+        return routerBfs(r, start, mazeCell(m, endx, endy), NULL);
+
+    if (r->row[start] == NULL)
+    {
+        long nbState = (long)m->nbCell * NB_CELL_STATE;
+        r->row[start] = malloc(nbState * sizeof(uint16_t));
+        if (r->row[start] == NULL)
+            return routerBfs(r, start, mazeCell(m, endx, endy), NULL);
+        memset(r->row[start], 0xff, nbState * sizeof(uint16_t));
+        routerBfs(r, start, -1, r->row[start]);
+    }
+
+    int best = NO_PATH;
+    for (l = 0; l < NB_CELL_STATE; l++)
+        if (r->row[start][end + l] != ROUTER_UNREACHED && r->row[start][end + l] < best)
+            best = r->row[start][end + l];
+    return best;
+}
+
+// Answer the header query, then "starty startx endy endx" lines until EOF
+static int runQueries(const struct Maze *m, int cache, struct Input *in,
+                      int startx, int starty, int endx, int endy)
+{
+    struct Router r;
+
+    if (routerInit(&r, m, cache) != 0)
+    {
+        routerFree(&r);
+        return -1;
+    }
+
+    do
+        printf("%d\n", routerQuery(&r, startx, starty, endx, endy));
+    while (inputInt(in, &starty) == 0 && inputInt(in, &startx) == 0 &&
+           inputInt(in, &endy) == 0 && inputInt(in, &endx) == 0);
+
+    routerFree(&r);
+    return 0;
+}
+
+/********************************** DYNAMIC ***********************************/
+/*
+Maps whose tiles change between queries: Lifelong Planning A* keeps, for
+each state, g (its distance found so far) and rhs (one more than the best g
+of its predecessors). The states where they differ are in a binary heap,
+keyed like A* on min(g, rhs) + the Manhattan distance to the exit. After an
+edit, only the states whose predecessors changed are updated, and the
+search goes on until the exit is consistent: it is only repaired around the
+edit, when a plain search would start over.
+The exit is a virtual state, one move after all the states of the end
+cell: a free move would tie its key with theirs, and the search could stop on an
+exit that was consistent only with their former distances.
+*/
+
+struct DynItem
+{
+    uint64_t key;
+    long     s;
+};
+
+struct Dyn
+{
+    struct Maze    *m;
+    long           start, goal;    // start at way 0, goal is the virtual exit
+    int            endCell;
+    int            endx, endy;
+    int            *g, *rhs;
+    int            *pos;        // index of each state in the heap, or -1
+    struct DynItem *heap;
+    int            len;
+    long           expanded;
+};
+
+static uint64_t dynKey(const struct Dyn *dy, long s)
+{
+    int k = dy->g[s] < dy->rhs[s] ? dy->g[s] : dy->rhs[s];
+    int h = 0;
+
+    if (s != dy->goal)
+        h = abs(mazeX(dy->m, stateCell(s)) - dy->endx) +
+            abs(mazeY(dy->m, stateCell(s)) - dy->endy);
+    return (uint64_t)(k + h) << 32 | k;
+}
+
+static void dynHeapSet(struct Dyn *dy, int i, struct DynItem item)
+{
+    dy->heap[i] = item;
+    dy->pos[item.s] = i;
+}
+
+static void dynSiftUp(struct Dyn *dy, int i)
+{
+    struct DynItem item = dy->heap[i];
+
+    while (i > 0 && dy->heap[(i - 1) / 2].key > item.key)
+    {
+        dynHeapSet(dy, i, dy->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    dynHeapSet(dy, i, item);
+}
+
+static void dynSiftDown(struct Dyn *dy, int i)
+{
+    struct DynItem item = dy->heap[i];
+
+    while (2 * i + 1 < dy->len)
+    {
+        int c = 2 * i + 1;
+        if (c + 1 < dy->len && dy->heap[c + 1].key < dy->heap[c].key)
+            c++;
+        if (dy->heap[c].key >= item.key)
+            break;
+        dynHeapSet(dy, i, dy->heap[c]);
+        i = c;
+    }
+    dynHeapSet(dy, i, item);
+}
+
+static void dynHeapRemove(struct Dyn *dy, long s)
+{
+    int i = dy->pos[s];
+
+    dy->pos[s] = -1;
+    if (--dy->len == i)
+        return;
+    dynHeapSet(dy, i, dy->heap[dy->len]);
+    if (i > 0 && dy->heap[(i - 1) / 2].key > dy->heap[i].key)
+        dynSiftUp(dy, i);
+    else
+        dynSiftDown(dy, i);
+}
+
+static void dynUpdate(struct Dyn *dy, long s)
+{
+    if (s != dy->start && s != dy->start + NB_LEVEL)
+    {
+        int best = NO_PATH, l, d;
+        if (s == dy->goal)
+        {
+            for (l = 0; l < NB_CELL_STATE; l++)
+                if (dy->g[mazeState(dy->endCell, 0, 0) + l] + 1 < best)
+                    best = dy->g[mazeState(dy->endCell, 0, 0) + l] + 1;
+        }
+        else
+            for (d = 0; d < NB_DIR; d++)
+            {
+                long ps = mazePred(dy->m, s, d);
+                if (ps >= 0 && dy->g[ps] + 1 < best &&
+                    !mazeBackToStart(dy->m, ps, s, stateCell(dy->start)))
+                    best = dy->g[ps] + 1;
+            }
+        dy->rhs[s] = best;
+    }
+
+    if (dy->pos[s] >= 0)
+        dynHeapRemove(dy, s);
+    if (dy->g[s] != dy->rhs[s])
+    {
+        struct DynItem item = {dynKey(dy, s), s};
+        dynHeapSet(dy, dy->len++, item);
+        dynSiftUp(dy, dy->len - 1);
+    }
+}
+
+static void dynUpdateNext(struct Dyn *dy, long s)
+{
+    unsigned moves = mazeMoves(dy->m, s);
+
+    for (; moves != 0; moves &= moves - 1)
+        dynUpdate(dy, mazeNext(dy->m, s, __builtin_ctz(moves)));
+    if (stateCell(s) == dy->endCell)
+        dynUpdate(dy, dy->goal);
+}
+
+// Distance from start to the exit, NO_PATH if none
+static int dynQuery(struct Dyn *dy)
+{
+    while (dy->len > 0 &&
+           (dy->heap[0].key < dynKey(dy, dy->goal) || dy->g[dy->goal] != dy->rhs[dy->goal]))
+    {
+        long s = dy->heap[0].s;
+        dynHeapRemove(dy, s);
+        dy->expanded++;
+        if (dy->g[s] > dy->rhs[s])
+        {
+            dy->g[s] = dy->rhs[s];
+            if (s != dy->goal)
+                dynUpdateNext(dy, s);
+        }
+        else
+        {
+            dy->g[s] = NO_PATH;
+            dynUpdate(dy, s);
+            if (s != dy->goal)
+                dynUpdateNext(dy, s);
+        }
+    }
+    return dy->g[dy->goal] < NO_PATH ? dy->g[dy->goal] - 1 : NO_PATH;
+}
+
+static int dynInit(struct Dyn *dy, struct Maze *m, int startx, int starty,
+                   int endx, int endy)
+{
+    long nbState = (long)m->nbCell * NB_CELL_STATE + 1, s;
+
+    memset(dy, 0x0, sizeof(struct Dyn));
+    dy->m = m;
+    // the heap positions are ints
+    if (nbState > INT_MAX)
+    {
+        fprintf(stderr, "Too many states for -d: %ld\n", nbState);
+        return -1;
+    }
+    dy->start = mazeState(mazeCell(m, startx, starty), 0, 0);
+    dy->endCell = mazeCell(m, endx, endy);
+    dy->goal = nbState - 1;
+    dy->endx = endx;
+    dy->endy = endy;
+    dy->g    = malloc(nbState * sizeof(int));
+    dy->rhs  = malloc(nbState * sizeof(int));
+    dy->pos  = malloc(nbState * sizeof(int));
+    dy->heap = malloc(nbState * sizeof(struct DynItem));
+    if (dy->g == NULL || dy->rhs == NULL || dy->pos == NULL || dy->heap == NULL)
+        return -1;
+
+    for (s = 0; s < nbState; s++)
+    {
+        dy->g[s] = dy->rhs[s] = NO_PATH;
+        dy->pos[s] = -1;
+    }
+    // both ways, whether the start is a slope or becomes one
+    dy->rhs[dy->start] = dy->rhs[dy->start + NB_LEVEL] = 0;
+    dynUpdate(dy, dy->start);
+    dynUpdate(dy, dy->start + NB_LEVEL);
+    return 0;
+}
+
+static void dynFree(struct Dyn *dy)
+{
+    free(dy->g);
+    free(dy->rhs);
+    free(dy->pos);
+    free(dy->heap);
+}
+
+/*
+Set the tile at (x, y) to c. The moves that change are from and onto that
+cell and its neighbours, so the states whose predecessors may change are
+at most 2 cells away.
+*/
+static void dynSetTile(struct Dyn *dy, int x, int y, char c)
+{
+    struct Maze *m = dy->m;
+    int ox, oy, l;
+
+    mazeSetTile(m, x, y, c);
+    for (oy = -2; oy <= 2; oy++)
+        for (ox = abs(oy) - 2; ox <= 2 - abs(oy); ox++)
+        {
+            if (x + ox < 0 || x + ox >= m->w || y + oy < 0 || y + oy >= m->h)
+                continue;
+            for (l = 0; l < NB_CELL_STATE; l++)
+                dynUpdate(dy, mazeState(mazeCell(m, x + ox, y + oy), 0, 0) + l);
+        }
+    dynUpdate(dy, dy->goal);
+}
+
+// Answer the header query, then one per "y x c" edit line until EOF
+static int runEdits(struct Maze *m, struct Input *in,
+                    int startx, int starty, int endx, int endy)
+{
+    struct Dyn dy;
+    int x, y;
+    const char *c;
+    // A start or an end off the map has no answer, as in routerQuery()
+    int inside = startx >= 0 && startx < m->w && starty >= 0 && starty < m->h &&
+                 endx >= 0 && endx < m->w && endy >= 0 && endy < m->h;
+
+    memset(&dy, 0x0, sizeof(struct Dyn));
+    if (inside && dynInit(&dy, m, startx, starty, endx, endy) != 0)
+    {
+        dynFree(&dy);
+        return -1;
+    }
+
+    printf("%d\n", inside ? dynQuery(&dy) : -1);
+    fprintf(stderr, "expanded=%ld\n", dy.expanded);
+    while (inputInt(in, &y) == 0 && inputInt(in, &x) == 0 && (c = inputRow(in, 1)) != NULL)
+    {
+        if (!inside || x < 0 || x >= m->w || y < 0 || y >= m->h)
+        {
+            printf("-1\n");
+            continue;
+        }
+        dy.expanded = 0;
+        dynSetTile(&dy, x, y, *c);
+        printf("%d\n", dynQuery(&dy));
+        fprintf(stderr, "edit (%d %d) '%c' expanded=%ld\n", x, y, *c, dy.expanded);
+    }
+
+    dynFree(&dy);
+    return 0;
+}
+
+/*********************************** MAIN *************************************/
+
+// To debug: fprintf(stderr, "Debug messages...\n");
+// Options: "-e bfs|astar|bibfs|par|tree" engine, "-t <nb threads>" for par,
+// "-q" more queries, "-a" cache them, "-p" print the path, "-d" tile edits,
+// "-v" echo the input on stderr.
+int main(int argc, char **argv)
+{
+    initRules();
+#ifdef CHECK_RULES
+    if (checkRules() != 0)
+        return -1;
+#endif
+
+    const char *engine = "bfs";
+    int multiQuery = 0, cache = 0, path = 0, edits = 0, verbose = 0;
+    int nbThread = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            engine = argv[++i];
+        else if (strcmp(argv[i], "-q") == 0)
+            multiQuery = 1;
+        else if (strcmp(argv[i], "-a") == 0)
+            cache = 1;
+        else if (strcmp(argv[i], "-p") == 0)
+            path = 1;
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            nbThread = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0)
+            edits = 1;
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = 1;
+    }
+
+    // Parse input
+    struct Input in;
+    int starty, startx, endy, endx, h, w;
+    if (inputOpen(&in, 0) != 0)
+    {
+        fprintf(stderr, "Cannot read the input\n");
+        return -1;
+    }
+    if (inputInt(&in, &starty) != 0 || inputInt(&in, &startx) != 0 ||
+        inputInt(&in, &endy) != 0 || inputInt(&in, &endx) != 0 ||
+        inputInt(&in, &h) != 0 || inputInt(&in, &w) != 0 || w <= 0 || h <= 0)
+    {
+        fprintf(stderr, "Wrong header\n");
+        return -1;
+    }
+    if (verbose)
+        fprintf(stderr, "start=(%d %d) end=(%d %d) size=(%d %d)\n",
+                startx, starty, endx, endy, w, h);
+
+    // The exhaustive tree still walks the rows as they are in the input
+    int tree = !multiQuery && !edits && !path && strcmp(engine, "tree") == 0;
+    char *maze = tree ? malloc((size_t)h * w) : NULL;
+    struct Maze m;
+    if (mazeInit(&m, w, h) != 0 || (tree && maze == NULL))
+        return -1;
+    for (int i = 0; i < h; i++)
+    {
+        const char *row = inputRow(&in, w);
+        if (row == NULL)
+        {
+            fprintf(stderr, "Row %d is not %d tiles long\n", i, w);
+            return -1;
+        }
+        mazeSetRow(&m, i, row);
+        if (tree)
+            memcpy(&maze[(size_t)i * w], row, w);
+        if (verbose)
+            fprintf(stderr, "%.*s\n", w, row);
+    }
+    if (mazeBuildMoves(&m) != 0)
+        return -1;
+
+    int n, ret = 0;
+    if (multiQuery)
+        ret = runQueries(&m, cache, &in, startx, starty, endx, endy);
+    else if (edits)
+        ret = runEdits(&m, &in, startx, starty, endx, endy);
+    // A start or an end off the map has no answer, as in routerQuery()
+    else if (startx < 0 || startx >= w || starty < 0 || starty >= h ||
+             endx < 0 || endx >= w || endy < 0 || endy >= h)
+        printf("-1\n");
+    else if (path)
+    {
+        n = pathMaze(&m, startx, starty, endx, endy, stdout);
+        ret = n < 0 ? n : 0;
+    }
+    else if (tree)
+    {
+        struct MazeNode treeMaze;
+        uint64_t *onPath = bitsetAlloc((long)w * h * NB_LEVEL);
+        initMazeTree(&treeMaze, maze, startx, starty, w);
+        buildMazeTree(&treeMaze, maze, w, h, onPath);
+        free(onPath);
+        n = travelMazeTree(&treeMaze, 0, endx, endy);
+        printf("%d\n", n);
+    }
+    else
+    {
+        struct SearchStat stat = {0, 0.0};
+        struct timespec t0, t1;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (strcmp(engine, "astar") == 0)
+            n = astarMaze(&m, startx, starty, endx, endy, &stat);
+        else if (strcmp(engine, "bibfs") == 0)
+            n = bibfsMaze(&m, startx, starty, endx, endy, &stat);
+        else if (strcmp(engine, "par") == 0)
+            n = parbfsMaze(&m, startx, starty, endx, endy, nbThread, &stat);
+        else
+            n = bfsMaze(&m, startx, starty, endx, endy, &stat);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        stat.ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+        fprintf(stderr, "engine=%s expanded=%ld time=%.3fms\n",
+                engine, stat.expanded, stat.ms);
+        printf("%d\n", n);
+    }
+
+    mazeFree(&m);
+    free(maze);
+    inputClose(&in);
+    return ret;
+}
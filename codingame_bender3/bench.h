@@ -0,0 +1,200 @@
+/*
+Micro-benchmark collector for the bender3 classifier: time a callback over a
+sweep of sizes and feed the samples straight to its fit, without going
+through the text format.
+
+Include it first (it needs _GNU_SOURCE for the CPU affinity), e.g.:
+
+    #include "../codingame_bender3/bench.h"
+
+    static void run(void *ctx, long n) { ... }
+
+    struct Bench bench = BENCH_DEFAULT;
+    enum BigO bigO = benchClassify(&bench, run, ctx, 1000, 100000, 32, 0);
+    return benchCheck(bigO, O_N, 1);
+
+or, for a gate that does not flip between neighbouring classes:
+
+    return benchCheckExponent(&bench, run, ctx, 1000, 100000, 32, O_N, 1);
+
+Each size gets `warmup` untimed runs, then `repeat` timed runs whose median
+is kept. Runs shorter than `minNs` are batched in a loop and divided, since
+the clock resolution is not far below the cost of the cheapest callbacks.
+*/
+#ifndef BENCH_H
+#define BENCH_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <time.h>
+
+#define BENDER3_NO_MAIN
+#include "main.c"
+
+#define BENCH_MAX_REPEAT 63
+
+typedef void (*BenchFn)(void *ctx, long n);
+
+struct Bench
+{
+    int  warmup;    // untimed runs per size
+    int  repeat;    // timed runs per size, at most BENCH_MAX_REPEAT
+    int  cpu;       // CPU to pin the thread to, -1 to leave it alone
+    long minNs;     // shortest timed batch
+};
+
+#define BENCH_DEFAULT {3, 9, 0, 20000}
+
+static inline int64_t benchNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Pin the calling thread, so that it is not migrated between timed runs
+int benchPin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return 0;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+static int64_t benchBatch(BenchFn fn, void *ctx, long n, long iters)
+{
+    long i;
+    int64_t start = benchNow();
+    for (i = 0; i < iters; i++)
+        fn(ctx, n);
+    return benchNow() - start;
+}
+
+// Median time of one call of fn(ctx, n), in ns
+double benchRun(const struct Bench *bench, BenchFn fn, void *ctx, long n)
+{
+    double smp[BENCH_MAX_REPEAT];
+    int i, j, repeat;
+    long iters = 1;
+
+    for (i = 0; i < bench->warmup; i++)
+        fn(ctx, n);
+    // Find how many calls it takes to fill minNs
+    while (benchBatch(fn, ctx, n, iters) < bench->minNs)
+        iters *= 2;
+
+    repeat = bench->repeat < 1 ? 1 : bench->repeat;
+    if (repeat > BENCH_MAX_REPEAT)
+        repeat = BENCH_MAX_REPEAT;
+    for (i = 0; i < repeat; i++)
+    {
+        double t = (double)benchBatch(fn, ctx, n, iters) / iters;
+        // insertion sort, repeat is small
+        for (j = i; j > 0 && smp[j - 1] > t; j--)
+            smp[j] = smp[j - 1];
+        smp[j] = t;
+    }
+    return smp[repeat / 2];
+}
+
+/*
+Time nbSize sizes from `from` to `to`, evenly spaced or, if geometric,
+with a constant ratio, and add them to fit. Return -1 on a bad range.
+*/
+int benchSweep(const struct Bench *bench, BenchFn fn, void *ctx,
+               long from, long to, int nbSize, int geometric, struct Fit *fit)
+{
+    int i;
+
+    if (from <= 0 || to < from || nbSize < 2)
+        return -1;
+    if (benchPin(bench->cpu) != 0)
+        fprintf(stderr, "Cannot pin to CPU %d\n", bench->cpu);
+
+    for (i = 0; i < nbSize; i++)
+    {
+        long n;
+        if (geometric)
+            n = lround(from * pow((double)to / from, (double)i / (nbSize - 1)));
+        else
+            n = from + (long)((double)(to - from) * i / (nbSize - 1));
+        fitAdd(fit, n, benchRun(bench, fn, ctx, n));
+    }
+    return 0;
+}
+
+// Sweep and return the best class, NB_O if none fits
+enum BigO benchClassify(const struct Bench *bench, BenchFn fn, void *ctx,
+                        long from, long to, int nbSize, int geometric)
+{
+    struct Fit fit;
+
+    initKernels();
+    memset(&fit, 0x0, sizeof(struct Fit));
+    if (benchSweep(bench, fn, ctx, from, to, nbSize, geometric, &fit) != 0)
+        return NB_O;
+    fitPrintSlopes(&fit);
+    return fitBestAffine(&fit, NULL, NULL);
+}
+
+/*
+Return 0 if bigO is expected, give or take `slack` classes: neighbours like
+O(n) and O(n log n) only differ by a log factor, which the timing noise of
+a sweep over a couple of decades can hide.
+*/
+int benchCheck(enum BigO bigO, enum BigO expected, int slack)
+{
+    printf("%s (expected %s)\n", bigO < NB_O ? strO[bigO] : "?", strO[expected]);
+    if (bigO == NB_O)
+        return -1;
+    return abs((int)bigO - (int)expected) <= slack ? 0 : -1;
+}
+
+// Exponent of class o between from and to, where it lands in the power fit
+static double benchClassExponent(enum BigO o, long from, long to)
+{
+    double f0[NB_O], f1[NB_O];
+
+    basis(f0, from);
+    basis(f1, to);
+    if (!isfinite(f1[o]))
+        return INFINITY;
+    return log(f1[o] / f0[o]) / log((double)to / from);
+}
+
+/*
+Time a geometric sweep and check the exponent p of t ~ n^p instead of the
+class: return 0 if its whole 95% interval is nearer to the exponent, over
+the same range, of a class at most `slack` away from expected than to any
+other. Neighbours like O(n) and O(n log^2 n) are a tenth apart in p, within
+the timing noise of the class fit, while p moves by a few hundredths.
+*/
+int benchCheckExponent(const struct Bench *bench, BenchFn fn, void *ctx,
+                       long from, long to, int nbSize, enum BigO expected, int slack)
+{
+    struct Fit fit;
+    double p, halfCI, lo, hi;
+    int below = (int)expected - slack < 0 ? 0 : (int)expected - slack;
+    int above = (int)expected + slack >= NB_O ? NB_O - 1 : (int)expected + slack;
+
+    initKernels();
+    memset(&fit, 0x0, sizeof(struct Fit));
+    if (benchSweep(bench, fn, ctx, from, to, nbSize, 1, &fit) != 0 ||
+        slopeEstimate(&fit.power, &p, &halfCI) != 0)
+        return -1;
+    // halfway to the first classes out of the slack
+    lo = below > 0 ? (benchClassExponent(below - 1, from, to) +
+                      benchClassExponent(below, from, to)) / 2 : -INFINITY;
+    hi = above < NB_O - 1 ? (benchClassExponent(above, from, to) +
+                             benchClassExponent(above + 1, from, to)) / 2 : INFINITY;
+    printf("n^%.3f (+-%.3f) (expected %s: n^%.3f..n^%.3f)\n",
+           p, halfCI, strO[expected], lo, hi);
+    return p - halfCI >= lo && p + halfCI <= hi ? 0 : -1;
+}
+
+#endif // BENCH_H
@@ -4,64 +4,110 @@ Comments: linear regression of the points, 1st, 2nd and 3rd derivative are calcu
 - If B coef of D derivative roughly equals A coef of D+1 derivative, it must be a O(n^D).
 - If B coef of D derivative is negative, it *should* be a O(n^D*log(n))
 */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // To debug: fprintf(stderr, "Debug messages...\n");
 
 #define MAX_NUM 15000
 #define MAX_T   10000000
 
+/*
+Classes, in growth order: X(id, name, f) where f is the basis function,
+written in terms of n and l = log(n). Adding a class is adding a line.
+*/
+#define BIG_O_TABLE(X) \
+    X(O_1,        "O(1)",           1.0)            \
+    X(O_LOGN,     "O(log n)",       l)              \
+    X(O_LOG2N,    "O(log^2 n)",     l * l)          \
+    X(O_SQRTN,    "O(sqrt n)",      sqrt(n))        \
+    X(O_N,        "O(n)",           n)              \
+    X(O_NLOGN,    "O(n log n)",     n * l)          \
+    X(O_NLOG2N,   "O(n log^2 n)",   n * l * l)      \
+    X(O_N1_5,     "O(n^1.5)",       n * sqrt(n))    \
+    X(O_N2,       "O(n^2)",         n * n)          \
+    X(O_N2LOGN,   "O(n^2 log n)",   n * n * l)      \
+    X(O_N3,       "O(n^3)",         n * n * n)      \
+    X(O_2N,       "O(2^n)",         exp2(n))
+
+#define BIG_O_ENUM(id, name, f) id,
 enum BigO
 {
-    O_1,
-    O_LOGN,
-    O_N,
-    O_NLOGN,
-    O_N2,
-    O_N2LOGN,
-    O_N3,
-    O_2N,
+    BIG_O_TABLE(BIG_O_ENUM)
     NB_O
 };
 
+#define BIG_O_NAME(id, name, f) name,
 const char *strO[NB_O] = 
     {
-        "O(1)",
-        "O(log n)",
-        "O(n)",
-        "O(n log n)",
-        "O(n^2)",
-        "O(n^2 log n)",
-        "O(n^3)",
-        "O(2^n)"
+        BIG_O_TABLE(BIG_O_NAME)
     };
 
-// sum(x) / n
-double mean(const double *samples, int n)
+/*********************************** KERNELS **********************************/
+/*
+The reductions and finite-difference stencils below come in scalar, SSE2 and
+AVX2 flavours; initKernels() picks one from the CPU features at startup.
+The vector flavours keep several independent accumulators, hence sum in a
+different order than the scalar ones: they agree within
+KERNEL_TOLERANCE(n) * sum(|term|), the rounding bound of an n terms sum.
+Build with -DCHECK_KERNELS to compare every flavour against the scalar one.
+*/
+#include <float.h>
+
+#define KERNEL_TOLERANCE(n) (2.0 * (n) * DBL_EPSILON)
+#define MAX_TAP 5
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+struct Kernels
+{
+    const char *name;
+    // sum(x)
+    double (*sum)(const double *x, int n);
+    // sum((x - mean)^2)
+    double (*sx)(const double *x, int n, double mean);
+    // sum((x - meanX) * (y - meanY))
+    double (*sxy)(const double *x, const double *y, int n,
+                  double meanX, double meanY);
+    // dy[i] = sum(tap[k] * y[i + k]), returns sum(dy)
+    double (*stencil)(double *dy, const double *y, int dn,
+                      const double *tap, int nbTap);
+};
+
+static double sumScalar(const double *x, int n)
 {
     int i;
     double sum = 0.0;
     for (i = 0; i < n; i++)
-        sum += samples[i];
-
-    return sum / n;
+        sum += x[i];
+    return sum;
 }
 
-double sx(const double *samples, int n, double mean)
+static double sxScalar(const double *x, int n, double mean)
 {
     int i;
     double sum = 0.0;
     for (i = 0; i < n; i++)
     {
-        double c = samples[i] - mean;
+        double c = x[i] - mean;
         sum += c * c;
     }
     return sum;
 }
 
-double sxy(const double *x, const double *y, int n, double meanX, double meanY)
+static double sxyScalar(const double *x, const double *y, int n,
+                        double meanX, double meanY)
 {
     int i;
     double sum = 0.0;
@@ -70,60 +116,389 @@ double sxy(const double *x, const double *y, int n, double meanX, double meanY)
     return sum;
 }
 
-void deriv(double **dx, double **dy, int *dn,
-           const double *x, const double *y, int n)
+static double stencilScalar(double *dy, const double *y, int dn,
+                            const double *tap, int nbTap)
+{
+    int i, k;
+    double sum = 0.0;
+    for (i = 0; i < dn; i++)
+    {
+        double v = 0.0;
+        for (k = 0; k < nbTap; k++)
+            v += tap[k] * y[i + k];
+        dy[i] = v;
+        sum += v;
+    }
+    return sum;
+}
+
+static const struct Kernels kernelsScalar =
+    {"scalar", sumScalar, sxScalar, sxyScalar, stencilScalar};
+
+#ifdef KERNELS_X86
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+TARGET_SSE2 static double hsum128(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+TARGET_SSE2 static double sumSse2(const double *x, int n)
 {
     int i;
-    *dn = n - 2;
-    *dx = malloc(*dn * sizeof(double));
-    *dy = malloc(*dn * sizeof(double));
-    double delta = x[1] - x[0];
-    for (i = 1; i < n - 1; i++)
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    __m128d a2 = _mm_setzero_pd(), a3 = _mm_setzero_pd();
+    for (i = 0; i + 8 <= n; i += 8)
     {
-        (*dx)[i-1] = x[i];
-        (*dy)[i-1] = (y[i+1] - y[i-1]) / (2 * delta);
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(x + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(x + i + 2));
+        a2 = _mm_add_pd(a2, _mm_loadu_pd(x + i + 4));
+        a3 = _mm_add_pd(a3, _mm_loadu_pd(x + i + 6));
     }
+    double sum = hsum128(_mm_add_pd(_mm_add_pd(a0, a1), _mm_add_pd(a2, a3)));
+    for (; i < n; i++)
+        sum += x[i];
+    return sum;
 }
 
-void deriv2(double **dx, double **dy, int *dn,
-            const double *x, const double *y, int n)
+TARGET_SSE2 static double sxSse2(const double *x, int n, double mean)
 {
     int i;
-    *dn = n - 2;
-    *dx = malloc(*dn * sizeof(double));
-    *dy = malloc(*dn * sizeof(double));
-    double delta = x[1] - x[0];
-    for (i = 1; i < n - 1; i++)
+    __m128d m = _mm_set1_pd(mean);
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    __m128d a2 = _mm_setzero_pd(), a3 = _mm_setzero_pd();
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m128d c0 = _mm_sub_pd(_mm_loadu_pd(x + i), m);
+        __m128d c1 = _mm_sub_pd(_mm_loadu_pd(x + i + 2), m);
+        __m128d c2 = _mm_sub_pd(_mm_loadu_pd(x + i + 4), m);
+        __m128d c3 = _mm_sub_pd(_mm_loadu_pd(x + i + 6), m);
+        a0 = _mm_add_pd(a0, _mm_mul_pd(c0, c0));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(c1, c1));
+        a2 = _mm_add_pd(a2, _mm_mul_pd(c2, c2));
+        a3 = _mm_add_pd(a3, _mm_mul_pd(c3, c3));
+    }
+    double sum = hsum128(_mm_add_pd(_mm_add_pd(a0, a1), _mm_add_pd(a2, a3)));
+    for (; i < n; i++)
+    {
+        double c = x[i] - mean;
+        sum += c * c;
+    }
+    return sum;
+}
+
+TARGET_SSE2 static double sxySse2(const double *x, const double *y, int n,
+                                  double meanX, double meanY)
+{
+    int i;
+    __m128d mx = _mm_set1_pd(meanX), my = _mm_set1_pd(meanY);
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    __m128d a2 = _mm_setzero_pd(), a3 = _mm_setzero_pd();
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(x + i), mx),
+                                       _mm_sub_pd(_mm_loadu_pd(y + i), my)));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(x + i + 2), mx),
+                                       _mm_sub_pd(_mm_loadu_pd(y + i + 2), my)));
+        a2 = _mm_add_pd(a2, _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(x + i + 4), mx),
+                                       _mm_sub_pd(_mm_loadu_pd(y + i + 4), my)));
+        a3 = _mm_add_pd(a3, _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(x + i + 6), mx),
+                                       _mm_sub_pd(_mm_loadu_pd(y + i + 6), my)));
+    }
+    double sum = hsum128(_mm_add_pd(_mm_add_pd(a0, a1), _mm_add_pd(a2, a3)));
+    for (; i < n; i++)
+        sum += (x[i] - meanX) * (y[i] - meanY);
+    return sum;
+}
+
+TARGET_SSE2 static double stencilSse2(double *dy, const double *y, int dn,
+                                      const double *tap, int nbTap)
+{
+    int i, k;
+    __m128d t[MAX_TAP];
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    for (k = 0; k < nbTap; k++)
+        t[k] = _mm_set1_pd(tap[k]);
+    for (i = 0; i + 4 <= dn; i += 4)
+    {
+        __m128d v0 = _mm_setzero_pd(), v1 = _mm_setzero_pd();
+        for (k = 0; k < nbTap; k++)
+        {
+            v0 = _mm_add_pd(v0, _mm_mul_pd(t[k], _mm_loadu_pd(y + i + k)));
+            v1 = _mm_add_pd(v1, _mm_mul_pd(t[k], _mm_loadu_pd(y + i + k + 2)));
+        }
+        _mm_storeu_pd(dy + i, v0);
+        _mm_storeu_pd(dy + i + 2, v1);
+        a0 = _mm_add_pd(a0, v0);
+        a1 = _mm_add_pd(a1, v1);
+    }
+    double sum = hsum128(_mm_add_pd(a0, a1));
+    for (; i < dn; i++)
+    {
+        double v = 0.0;
+        for (k = 0; k < nbTap; k++)
+            v += tap[k] * y[i + k];
+        dy[i] = v;
+        sum += v;
+    }
+    return sum;
+}
+
+TARGET_AVX2 static double hsum256(__m256d v)
+{
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+}
+
+TARGET_AVX2 static double sumAvx2(const double *x, int n)
+{
+    int i;
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(x + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(x + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(x + i + 12));
+    }
+    double sum = hsum256(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++)
+        sum += x[i];
+    return sum;
+}
+
+TARGET_AVX2 static double sxAvx2(const double *x, int n, double mean)
+{
+    int i;
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        __m256d c0 = _mm256_sub_pd(_mm256_loadu_pd(x + i), m);
+        __m256d c1 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 4), m);
+        __m256d c2 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 8), m);
+        __m256d c3 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 12), m);
+        a0 = _mm256_fmadd_pd(c0, c0, a0);
+        a1 = _mm256_fmadd_pd(c1, c1, a1);
+        a2 = _mm256_fmadd_pd(c2, c2, a2);
+        a3 = _mm256_fmadd_pd(c3, c3, a3);
+    }
+    double sum = hsum256(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++)
     {
-        (*dx)[i-1] = x[i];
-        (*dy)[i-1] = (y[i+1] - 2 * y[i] + y[i-1]) / (delta * delta);
+        double c = x[i] - mean;
+        sum += c * c;
     }
+    return sum;
 }
 
-void deriv3(double **dx, double **dy, int *dn,
-            const double *x, const double *y, int n)
+TARGET_AVX2 static double sxyAvx2(const double *x, const double *y, int n,
+                                  double meanX, double meanY)
 {
     int i;
-    *dn = n - 4;
+    __m256d mx = _mm256_set1_pd(meanX), my = _mm256_set1_pd(meanY);
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        a0 = _mm256_fmadd_pd(_mm256_sub_pd(_mm256_loadu_pd(x + i), mx),
+                             _mm256_sub_pd(_mm256_loadu_pd(y + i), my), a0);
+        a1 = _mm256_fmadd_pd(_mm256_sub_pd(_mm256_loadu_pd(x + i + 4), mx),
+                             _mm256_sub_pd(_mm256_loadu_pd(y + i + 4), my), a1);
+        a2 = _mm256_fmadd_pd(_mm256_sub_pd(_mm256_loadu_pd(x + i + 8), mx),
+                             _mm256_sub_pd(_mm256_loadu_pd(y + i + 8), my), a2);
+        a3 = _mm256_fmadd_pd(_mm256_sub_pd(_mm256_loadu_pd(x + i + 12), mx),
+                             _mm256_sub_pd(_mm256_loadu_pd(y + i + 12), my), a3);
+    }
+    double sum = hsum256(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++)
+        sum += (x[i] - meanX) * (y[i] - meanY);
+    return sum;
+}
+
+TARGET_AVX2 static double stencilAvx2(double *dy, const double *y, int dn,
+                                      const double *tap, int nbTap)
+{
+    int i, k;
+    __m256d t[MAX_TAP];
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    for (k = 0; k < nbTap; k++)
+        t[k] = _mm256_set1_pd(tap[k]);
+    for (i = 0; i + 8 <= dn; i += 8)
+    {
+        __m256d v0 = _mm256_setzero_pd(), v1 = _mm256_setzero_pd();
+        for (k = 0; k < nbTap; k++)
+        {
+            v0 = _mm256_fmadd_pd(t[k], _mm256_loadu_pd(y + i + k), v0);
+            v1 = _mm256_fmadd_pd(t[k], _mm256_loadu_pd(y + i + k + 4), v1);
+        }
+        _mm256_storeu_pd(dy + i, v0);
+        _mm256_storeu_pd(dy + i + 4, v1);
+        a0 = _mm256_add_pd(a0, v0);
+        a1 = _mm256_add_pd(a1, v1);
+    }
+    double sum = hsum256(_mm256_add_pd(a0, a1));
+    for (; i < dn; i++)
+    {
+        double v = 0.0;
+        for (k = 0; k < nbTap; k++)
+            v += tap[k] * y[i + k];
+        dy[i] = v;
+        sum += v;
+    }
+    return sum;
+}
+
+static const struct Kernels kernelsSse2 =
+    {"sse2", sumSse2, sxSse2, sxySse2, stencilSse2};
+static const struct Kernels kernelsAvx2 =
+    {"avx2", sumAvx2, sxAvx2, sxyAvx2, stencilAvx2};
+
+#endif // KERNELS_X86
+
+static const struct Kernels *g_kernels = &kernelsScalar;
+
+void initKernels(void)
+{
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        g_kernels = &kernelsAvx2;
+    else if (__builtin_cpu_supports("sse2"))
+        g_kernels = &kernelsSse2;
+#endif
+}
+
+#ifdef CHECK_KERNELS
+static int checkClose(const char *what, const struct Kernels *k,
+                      double got, double ref, double absSum, int n)
+{
+    if (fabs(got - ref) <= KERNEL_TOLERANCE(n) * absSum)
+        return 0;
+    fprintf(stderr, "%s: %s=%.17g scalar=%.17g\n", k->name, what, got, ref);
+    return -1;
+}
+
+// Compare a kernel flavour against the scalar one on a noisy n^2 curve
+static int checkKernels(const struct Kernels *k)
+{
+    const double tap[4][MAX_TAP] = {{-0.5, 0.0, 0.5}, {1.0, -2.0, 1.0},
+                                    {-0.5, 1.0, 0.0, -1.0, 0.5}, {1.0}};
+    const int nbTap[4] = {3, 3, 5, 1};
+    int n, i, t, ret = 0;
+
+    for (n = 1; n < 1000; n = n * 3 + 1)
+    {
+        double *x  = malloc(n * sizeof(double));
+        double *y  = malloc(n * sizeof(double));
+        double *d0 = malloc(n * sizeof(double));
+        double *d1 = malloc(n * sizeof(double));
+        double absX = 0.0, absY = 0.0, absXY = 0.0;
+        for (i = 0; i < n; i++)
+        {
+            x[i] = i + 1;
+            y[i] = x[i] * x[i] * (1.0 + (rand() % 100) / 1000.0);
+            absX += x[i] * x[i];
+            absY += y[i];
+            absXY += x[i] * y[i];
+        }
+        double mx = sumScalar(x, n) / n, my = sumScalar(y, n) / n;
+        ret |= checkClose("sum", k, k->sum(y, n), sumScalar(y, n), absY, n);
+        ret |= checkClose("sx", k, k->sx(x, n, mx), sxScalar(x, n, mx), absX, n);
+        ret |= checkClose("sxy", k, k->sxy(x, y, n, mx, my),
+                          sxyScalar(x, y, n, mx, my), absXY, n);
+        for (t = 0; t < 4; t++)
+        {
+            int dn = n - nbTap[t] + 1;
+            if (dn <= 0)
+                continue;
+            double s0 = stencilScalar(d0, y, dn, tap[t], nbTap[t]);
+            double s1 = k->stencil(d1, y, dn, tap[t], nbTap[t]);
+            ret |= checkClose("stencil", k, s1, s0, 8.0 * absY, dn);
+            for (i = 0; i < dn; i++)
+                ret |= checkClose("stencil[i]", k, d1[i], d0[i], 8.0 * y[i + nbTap[t] - 1], MAX_TAP);
+        }
+        free(x);
+        free(y);
+        free(d0);
+        free(d1);
+    }
+    fprintf(stderr, "kernels %s: %s\n", k->name, ret ? "FAILED" : "ok");
+    return ret;
+}
+#endif // CHECK_KERNELS
+
+/*********************************** SERIES ***********************************/
+
+// sum(x) / n
+double mean(const double *samples, int n)
+{
+    return g_kernels->sum(samples, n) / n;
+}
+
+double sx(const double *samples, int n, double mean)
+{
+    return g_kernels->sx(samples, n, mean);
+}
+
+double sxy(const double *x, const double *y, int n, double meanX, double meanY)
+{
+    return g_kernels->sxy(x, y, n, meanX, meanY);
+}
+
+// Apply a finite-difference stencil centred on x[off..n-off[ and return the
+// mean of the derivative, accumulated in the same pass.
+static double diff(double **dx, double **dy, int *dn,
+                   const double *x, const double *y, int n,
+                   const double *tap, int nbTap)
+{
+    int off = nbTap / 2;
+    *dn = n - 2 * off;
     *dx = malloc(*dn * sizeof(double));
     *dy = malloc(*dn * sizeof(double));
+    memcpy(*dx, x + off, *dn * sizeof(double));
+    return g_kernels->stencil(*dy, y, *dn, tap, nbTap) / *dn;
+}
+
+double deriv(double **dx, double **dy, int *dn,
+             const double *x, const double *y, int n)
+{
     double delta = x[1] - x[0];
-    for (i = 2; i < n - 2; i++)
-    {
-        (*dx)[i-2] = x[i];
-        (*dy)[i-2] = (y[i+2] - 2 * y[i+1] + 2 * y[i-1] - y[i-2]) / (2 * delta * delta * delta);
-    }
+    double k = 1.0 / (2 * delta);
+    const double tap[3] = {-k, 0.0, k};
+    return diff(dx, dy, dn, x, y, n, tap, 3);
 }
 
-int checkO1(const double *x, const double *y, int n)
+double deriv2(double **dx, double **dy, int *dn,
+              const double *x, const double *y, int n)
 {
-    double meanX, meanY;
+    double delta = x[1] - x[0];
+    double k = 1.0 / (delta * delta);
+    const double tap[3] = {k, -2 * k, k};
+    return diff(dx, dy, dn, x, y, n, tap, 3);
+}
+
+double deriv3(double **dx, double **dy, int *dn,
+              const double *x, const double *y, int n)
+{
+    double delta = x[1] - x[0];
+    double k = 1.0 / (2 * delta * delta * delta);
+    const double tap[5] = {-k, 2 * k, 0.0, -2 * k, k};
+    return diff(dx, dy, dn, x, y, n, tap, 5);
+}
+
+int checkO1(const double *x, const double *y, int n, double meanY)
+{
+    double meanX;
     double linearA, linearB;
     
     #define THRESHOLD 0.0001
     
     meanX = mean(x, n);
-    meanY = mean(y, n);
     
     linearB = sxy(x, y, n, meanX, meanY) / sx(x, n, meanX);
     linearA = meanY - linearB * meanX;
@@ -133,16 +508,592 @@ int checkO1(const double *x, const double *y, int n)
     return 0;
 }
 
-int main()
+/*********************************** FITTING **********************************/
+/*
+Every class is fitted as t = b * f(n), with a single coefficient: the class
+with the lowest residual wins. The sums kept in struct Fit give
+b = Sft / Sff and residual = Stt - Sft^2 / Sff, and are updated in O(1) per
+class when a sample enters or leaves, which is what the sliding window of
+the online mode relies on.
+*/
+
+// Beyond that, f(n)^2 overflows and the class is dropped
+#define MAX_BASIS 1e150
+
+// f[o] = basis of every class at n, log(n) being computed only once
+static void basis(double f[NB_O], double n)
+{
+    double l = log(n);
+    (void)l;
+#define BIG_O_BASIS(id, name, expr) f[id] = (expr);
+    BIG_O_TABLE(BIG_O_BASIS)
+}
+
+/*
+Besides the classes, two slopes are fitted by least squares: log(t) against
+log(n) gives the exponent p of t ~ n^p, log(t) against n gives log(k) of
+t ~ k^n. Their confidence interval is +-1.96 standard errors, i.e. 95% under
+the normal approximation, which holds for more than ~30 samples.
+*/
+struct Slope
+{
+    int    count;
+    double sx, sy, sxx, syy, sxy;
+};
+
+static void slopeUpdate(struct Slope *slope, double x, double y, int sign)
+{
+    slope->count += sign;
+    slope->sx  += sign * x;
+    slope->sy  += sign * y;
+    slope->sxx += sign * x * x;
+    slope->syy += sign * y * y;
+    slope->sxy += sign * x * y;
+}
+
+// Return -1 if there are not enough samples to tell
+int slopeEstimate(const struct Slope *slope, double *b, double *halfCI)
+{
+    double n = slope->count;
+    if (slope->count < 3)
+        return -1;
+
+    double cxx = slope->sxx - slope->sx * slope->sx / n;
+    double cyy = slope->syy - slope->sy * slope->sy / n;
+    double cxy = slope->sxy - slope->sx * slope->sy / n;
+    if (cxx <= 0.0)
+        return -1;
+
+    *b = cxy / cxx;
+    double var = (cyy - *b * cxy) / (n - 2);
+    *halfCI = 1.96 * sqrt(fmax(var, 0.0) / cxx);
+    return 0;
+}
+
+struct Fit
+{
+    int    count;
+    double st, stt;
+    double sf[NB_O];
+    double sft[NB_O];
+    double sff[NB_O];
+    int    nbOverflow[NB_O];    // samples where f(n) is too big
+    struct Slope power;         // log(t) = p * log(n) + c
+    struct Slope expo;          // log(t) = log(k) * n + c
+};
+
+static void fitUpdate(struct Fit *fit, double n, double t, int sign)
+{
+    int o;
+    double f[NB_O];
+
+    fit->count += sign;
+    fit->st  += sign * t;
+    fit->stt += sign * t * t;
+    basis(f, n);
+    for (o = 0; o < NB_O; o++)
+    {
+        if (!(fabs(f[o]) < MAX_BASIS))
+        {
+            fit->nbOverflow[o] += sign;
+            continue;
+        }
+        fit->sf[o]  += sign * f[o];
+        fit->sft[o] += sign * f[o] * t;
+        fit->sff[o] += sign * f[o] * f[o];
+    }
+
+    // Logs are only defined on positive samples
+    if (n > 0.0 && t > 0.0)
+    {
+        double lt = log(t);
+        slopeUpdate(&fit->power, log(n), lt, sign);
+        slopeUpdate(&fit->expo, n, lt, sign);
+    }
+}
+
+void fitAdd(struct Fit *fit, double n, double t)
+{
+    fitUpdate(fit, n, t, 1);
+}
+
+void fitRemove(struct Fit *fit, double n, double t)
+{
+    fitUpdate(fit, n, t, -1);
+}
+
+// Return the best class, or NB_O if none can be fitted
+enum BigO fitBest(const struct Fit *fit, double *coef)
+{
+    int o;
+    enum BigO best = NB_O;
+    double bestRes = INFINITY;
+
+    for (o = 0; o < NB_O; o++)
+    {
+        if (fit->nbOverflow[o] > 0 || fit->sff[o] <= 0.0)
+            continue;
+        double res = fit->stt - fit->sft[o] * fit->sft[o] / fit->sff[o];
+        if (res < bestRes)
+        {
+            bestRes = res;
+            best = o;
+            if (coef != NULL)
+                *coef = fit->sft[o] / fit->sff[o];
+        }
+    }
+    return best;
+}
+
+/*
+Same with t = a + b * f(n), for samples carrying a fixed overhead (e.g. the
+call of a benchmarked function) that would bias the fit without intercept.
+With an intercept, O(1) is nested in every other class, so it is only
+chosen when the best of them explains less than FIT_MIN_R2 of the variance.
+*/
+#define FIT_MIN_R2 0.5
+
+enum BigO fitBestAffine(const struct Fit *fit, double *intercept, double *coef)
+{
+    int o;
+    enum BigO best = NB_O;
+    double n = fit->count, bestRes = INFINITY;
+
+    if (fit->count < 3)
+        return NB_O;
+
+    double ctt = fit->stt - fit->st * fit->st / n;
+    for (o = 0; o < NB_O; o++)
+    {
+        if (o == O_1 || fit->nbOverflow[o] > 0)
+            continue;
+        double cff = fit->sff[o] - fit->sf[o] * fit->sf[o] / n;
+        double cft = fit->sft[o] - fit->sf[o] * fit->st / n;
+        if (cff <= 0.0)
+            continue;
+        double res = ctt - cft * cft / cff;
+        if (res < bestRes)
+        {
+            bestRes = res;
+            best = o;
+            if (coef != NULL)
+                *coef = cft / cff;
+            if (intercept != NULL)
+                *intercept = (fit->st - cft / cff * fit->sf[o]) / n;
+        }
+    }
+
+    if (best == NB_O || !(bestRes < (1.0 - FIT_MIN_R2) * ctt))
+    {
+        if (coef != NULL)
+            *coef = 0.0;
+        if (intercept != NULL)
+            *intercept = fit->st / n;
+        return O_1;
+    }
+    return best;
+}
+
+// Print the power law and exponential estimates
+void fitPrintSlopes(const struct Fit *fit)
+{
+    double b, halfCI;
+
+    if (slopeEstimate(&fit->power, &b, &halfCI) == 0)
+        fprintf(stderr, "t ~ n^%.3f (+-%.3f)\n", b, halfCI);
+    if (slopeEstimate(&fit->expo, &b, &halfCI) == 0)
+        fprintf(stderr, "t ~ %.4f^n (%.4f..%.4f)\n",
+                exp(b), exp(b - halfCI), exp(b + halfCI));
+}
+
+/************************************ DRIFT ***********************************/
+/*
+Online mode: the last `window` samples are kept in a ring, along with their
+struct Fit. A change event is emitted when the best class differs from the
+last reported one, or its coefficient moved by more than DRIFT_SHIFT, and
+that same class stayed the best for half a window, its coefficient within
+DRIFT_SHIFT of where it started: while the change point crosses the window,
+the mix of both curves fits whatever is closest, with a coefficient that
+keeps moving, which must not be reported.
+*/
+
+#define DRIFT_SHIFT   0.25
+
+struct Drift
+{
+    int        window;
+    double     *ringN, *ringT;
+    int        head, len;
+    long       nbSeen;
+    int        nbSinceRefresh;
+    struct Fit fit;
+    enum BigO  bigO;        // class of the last event, NB_O before the first
+    double     coef;        // its coefficient
+    enum BigO  candidate;   // class waiting for confirmation
+    double     candCoef;    // its coefficient when it became the candidate
+    int        nbConfirm;   // samples it stayed the best since
+};
+
+int driftInit(struct Drift *drift, int window)
+{
+    memset(drift, 0x0, sizeof(struct Drift));
+    drift->ringN = malloc(window * sizeof(double));
+    drift->ringT = malloc(window * sizeof(double));
+    if (drift->ringN == NULL || drift->ringT == NULL)
+    {
+        free(drift->ringN);
+        free(drift->ringT);
+        return -1;
+    }
+    drift->window = window;
+    drift->bigO = drift->candidate = NB_O;
+    return 0;
+}
+
+void driftFree(struct Drift *drift)
+{
+    free(drift->ringN);
+    free(drift->ringT);
+}
+
+// Recompute the sums from the ring, to cancel rounding left by removals
+static void driftRefresh(struct Drift *drift)
+{
+    int i;
+
+    memset(&drift->fit, 0x0, sizeof(struct Fit));
+    for (i = 0; i < drift->len; i++)
+    {
+        int r = (drift->head + i) % drift->window;
+        fitAdd(&drift->fit, drift->ringN[r], drift->ringT[r]);
+    }
+    drift->nbSinceRefresh = 0;
+}
+
+// Push a sample. Return 1 and update bigO/coef when a change is detected.
+int driftPush(struct Drift *drift, double n, double t)
+{
+    int tail;
+    double coef;
+    enum BigO best;
+
+    if (drift->len == drift->window)
+    {
+        fitRemove(&drift->fit, drift->ringN[drift->head], drift->ringT[drift->head]);
+        drift->head = (drift->head + 1) % drift->window;
+        drift->len--;
+    }
+    tail = (drift->head + drift->len) % drift->window;
+    drift->ringN[tail] = n;
+    drift->ringT[tail] = t;
+    drift->len++;
+    drift->nbSeen++;
+    fitAdd(&drift->fit, n, t);
+
+    if (++drift->nbSinceRefresh >= drift->window)
+        driftRefresh(drift);
+
+    // Wait for a full window before judging
+    if (drift->len < drift->window)
+        return 0;
+
+    best = fitBest(&drift->fit, &coef);
+    if (best == NB_O)
+        return 0;
+
+    if (best == drift->bigO &&
+        fabs(coef - drift->coef) <= DRIFT_SHIFT * fabs(drift->coef))
+    {
+        drift->candidate = NB_O;
+        drift->nbConfirm = 0;
+        return 0;
+    }
+
+    // Another class, or the same one moving, starts the confirmation over
+    if (best != drift->candidate ||
+        fabs(coef - drift->candCoef) > DRIFT_SHIFT * fabs(drift->candCoef))
+    {
+        drift->candidate = best;
+        drift->candCoef = coef;
+        drift->nbConfirm = 0;
+    }
+    if (drift->bigO != NB_O && ++drift->nbConfirm < drift->window / 2)
+        return 0;
+
+    drift->bigO = best;
+    drift->coef = coef;
+    drift->candidate = NB_O;
+    drift->nbConfirm = 0;
+    return 1;
+}
+
+/************************************ TRACE ***********************************/
+/*
+Binary trace: a struct TraceHeader followed by `count` struct TraceRecord,
+all in host byte order (a byte-swapped magic is rejected). The file is
+mmap'ed and the records are fed to the fit as they are, without any copy or
+parse step. "-c <file>" converts the text input into that format.
+*/
+
+#define TRACE_MAGIC 0x31525442  // "BTR1"
+
+enum TraceUnit
+{
+    UNIT_NS,
+    UNIT_US,
+    UNIT_MS,
+    UNIT_CYCLES,
+    NB_UNIT
+};
+
+const char *strUnit[NB_UNIT] = {"ns", "us", "ms", "cycles"};
+
+struct TraceHeader
+{
+    uint32_t magic;
+    uint32_t unit;      // enum TraceUnit
+    uint64_t count;     // nb of records
+    uint64_t spacing;   // constant step between n, 0 if not constant
+    uint64_t reserved;
+};
+
+struct TraceRecord
+{
+    uint64_t n;
+    uint64_t t;
+};
+
+struct Trace
+{
+    const struct TraceHeader *header;
+    const struct TraceRecord *records;
+    size_t                    size;
+};
+
+int traceOpen(struct Trace *trace, const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct TraceHeader))
+    {
+        close(fd);
+        return -2;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -3;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    trace->header  = map;
+    trace->records = (const struct TraceRecord *)(trace->header + 1);
+    trace->size    = st.st_size;
+    if (trace->header->magic != TRACE_MAGIC ||
+        trace->header->unit >= NB_UNIT ||
+        trace->header->count > (st.st_size - sizeof(struct TraceHeader)) /
+                               sizeof(struct TraceRecord))
+    {
+        munmap(map, st.st_size);
+        return -4;
+    }
+    return 0;
+}
+
+void traceClose(struct Trace *trace)
+{
+    munmap((void *)trace->header, trace->size);
+}
+
+// Command line front-end, left out when included by bench.h
+#ifndef BENDER3_NO_MAIN
+
+// Convert the text input (count, then "num t" pairs) to a binary trace.
+// On a write error, a partial regular file is removed.
+static int traceConvert(const char *path, enum TraceUnit unit)
+{
+    struct TraceHeader header;
+    struct TraceRecord rec, prev = {0, 0};
+    struct stat st;
+    uint64_t i, count;
+    int regular;
+    FILE *f;
+
+    if (scanf("%" SCNu64, &count) != 1)
+        return -1;
+    f = fopen(path, "wb");
+    if (f == NULL)
+        return -2;
+    regular = fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode);
+
+    memset(&header, 0x0, sizeof(struct TraceHeader));
+    header.magic = TRACE_MAGIC;
+    header.unit  = unit;
+    if (fwrite(&header, sizeof(struct TraceHeader), 1, f) != 1)
+        goto fail;
+
+    for (i = 0; i < count; i++)
+    {
+        if (scanf("%" SCNu64 "%" SCNu64, &rec.n, &rec.t) != 2)
+            break;
+        if (i == 1)
+            header.spacing = rec.n - prev.n;
+        else if (i >= 2 && rec.n - prev.n != header.spacing)
+            header.spacing = 0;
+        if (fwrite(&rec, sizeof(struct TraceRecord), 1, f) != 1)
+            goto fail;
+        prev = rec;
+    }
+    header.count = i;
+
+    // Rewrite the header, now that the count and spacing are known
+    if (fseek(f, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(struct TraceHeader), 1, f) != 1)
+        goto fail;
+    if (fclose(f) == 0)
+        return 0;
+    f = NULL;
+
+fail:
+    if (f != NULL)
+        fclose(f);
+    if (regular)
+        unlink(path);
+    return -3;
+}
+
+static int runTrace(const struct Trace *trace)
+{
+    struct Fit fit;
+    uint64_t i;
+    double coef = 0.0;
+
+    memset(&fit, 0x0, sizeof(struct Fit));
+    for (i = 0; i < trace->header->count; i++)
+        fitAdd(&fit, trace->records[i].n, trace->records[i].t);
+
+    enum BigO bigO = fitBest(&fit, &coef);
+    if (bigO == NB_O)
+        bigO = O_1;
+    fprintf(stderr, "N=%" PRIu64 " spacing=%" PRIu64 " coef=%g%s\n",
+            trace->header->count, trace->header->spacing, coef,
+            strUnit[trace->header->unit]);
+    fitPrintSlopes(&fit);
+
+    printf("%s\n", strO[bigO]);
+    return 0;
+}
+
+// Print a line per change, on "num t" pairs read until EOF or on a trace
+static int runDrift(int window, const struct Trace *trace)
+{
+    struct Drift drift;
+    uint64_t i = 0;
+    double num, t;
+
+    if (window < 2 || driftInit(&drift, window) != 0)
+        return -1;
+
+    while (1)
+    {
+        if (trace != NULL)
+        {
+            if (i >= trace->header->count)
+                break;
+            num = trace->records[i].n;
+            t   = trace->records[i].t;
+            i++;
+        }
+        else if (scanf("%lf%lf", &num, &t) != 2)
+            break;
+
+        if (driftPush(&drift, num, t))
+            printf("%ld %.0f %s %g\n", drift.nbSeen, num, strO[drift.bigO], drift.coef);
+    }
+
+    driftFree(&drift);
+    return 0;
+}
+
+int main(int argc, char **argv)
 {
     int n, dn;  // ]5, 1000[
     double *smpX, *smpY, deltaT;
+    struct Fit fit;
+
+    initKernels();
+#ifdef CHECK_KERNELS
+    checkKernels(&kernelsScalar);
+#ifdef KERNELS_X86
+    checkKernels(&kernelsSse2);
+    if (g_kernels == &kernelsAvx2)
+        checkKernels(&kernelsAvx2);
+#endif
+#endif
+
+    // Options: "-o <window>" online mode, "-b <file>" read a binary trace,
+    // "-c <file>" convert the text input to a binary trace, "-u <unit>"
+    // its time unit
+    int window = 0;
+    const char *binPath = NULL, *convPath = NULL;
+    enum TraceUnit unit = UNIT_NS;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-o") == 0)
+            window = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-b") == 0)
+            binPath = argv[i + 1];
+        else if (strcmp(argv[i], "-c") == 0)
+            convPath = argv[i + 1];
+        else if (strcmp(argv[i], "-u") == 0)
+        {
+            for (unit = 0; unit < NB_UNIT; unit++)
+                if (strcmp(argv[i + 1], strUnit[unit]) == 0)
+                    break;
+            if (unit == NB_UNIT)
+            {
+                fprintf(stderr, "Unknown unit %s, use", argv[i + 1]);
+                for (unit = 0; unit < NB_UNIT; unit++)
+                    fprintf(stderr, " %s", strUnit[unit]);
+                fprintf(stderr, "\n");
+                return -1;
+            }
+        }
+    }
+
+    if (convPath != NULL)
+    {
+        int ret = traceConvert(convPath, unit);
+        if (ret != 0)
+            fprintf(stderr, "Cannot convert to trace %s (%d)\n", convPath, ret);
+        return ret;
+    }
+
+    if (binPath != NULL)
+    {
+        struct Trace trace;
+        int ret = traceOpen(&trace, binPath);
+        if (ret != 0)
+        {
+            fprintf(stderr, "Cannot map trace %s (%d)\n", binPath, ret);
+            return ret;
+        }
+        ret = window > 0 ? runDrift(window, &trace) : runTrace(&trace);
+        traceClose(&trace);
+        return ret;
+    }
+
+    if (window > 0)
+        return runDrift(window, NULL);
     
     scanf("%d", &n);
     fprintf(stderr, "N=%d\n", n);
     
     smpX = malloc(n * sizeof(double));
     smpY = malloc(n * sizeof(double));
+    memset(&fit, 0x0, sizeof(struct Fit));
     for (int i = 0; i < n; i++)
     {
         int num;
@@ -152,6 +1103,7 @@ int main()
         // Normalize
         smpX[i] = (double)num /*/ MAX_NUM*/;
         smpY[i] = (double)t   /*/ MAX_T*/;
+        fitAdd(&fit, smpX[i], smpY[i]);
         if (i == 1)
             deltaT = smpX[i] - smpX[i - 1];
         else if (i >= 2)
@@ -173,19 +1125,24 @@ int main()
 
     double *dY, *ddY, *dddY;
     double *dX, *ddX, *dddX;
-    checkO1(smpX, smpY, n);
-    deriv(&dX, &dY, &dn, smpX, smpY, n);
-    checkO1(dX, dY, dn);
-    deriv2(&ddX, &ddY, &dn, smpX, smpY, n);
-    checkO1(ddX, ddY, dn);
-    deriv3(&dddX, &dddY, &dn, smpX, smpY, n);
+    double meanD;
+    checkO1(smpX, smpY, n, mean(smpY, n));
+    meanD = deriv(&dX, &dY, &dn, smpX, smpY, n);
+    checkO1(dX, dY, dn, meanD);
+    meanD = deriv2(&ddX, &ddY, &dn, smpX, smpY, n);
+    checkO1(ddX, ddY, dn, meanD);
+    meanD = deriv3(&dddX, &dddY, &dn, smpX, smpY, n);
     /*for (int i = 0; i < dn; i++)
         fprintf(stderr, "d3=%f\n", dddY[i]);*/
-    checkO1(dddX, dddY, dn);
+    checkO1(dddX, dddY, dn, meanD);
 
-    enum BigO bigO = O_1;
+    fitPrintSlopes(&fit);
+    enum BigO bigO = fitBest(&fit, NULL);
+    if (bigO == NB_O)
+        bigO = O_1;
     
     printf("%s\n", strO[bigO]);
 
     return 0;
 }
+#endif // BENDER3_NO_MAIN
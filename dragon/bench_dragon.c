@@ -0,0 +1,54 @@
+#include "../codingame_bender3/bench.h"
+
+/*
+Check the asymptotic class of the dragon lookups with the bender3 classifier.
+
+gcc -O2 bench_dragon.c -o bench_dragon -lm
+gcc -O2 -DLOGN bench_dragon.c -o bench_dragon_logn -lm
+
+Exits with 1 when the measured cost is not the expected class, or a neighbour:
+- dragon_n.c walks the curve up to nF: O(nF) at a fixed order. The gate is
+  on the exponent of the power fit, which the class fit over a single
+  decade or two cannot tell from O(n log^2 n).
+- dragon_logn.c loops over the bits of the order: O(log nF) when the order
+  is the smallest one holding nF. Its cost also depends on the set bits of
+  nF, so the worst case of each order (all bits set) is timed.
+*/
+
+#define DRAGON_NO_MAIN
+#ifdef LOGN
+#include "dragon_logn.c"
+#else
+#include "dragon_n.c"
+#endif
+
+struct Sink
+{
+    int x, y;
+};
+
+static void runDragon(void *ctx, long n)
+{
+    struct Sink *sink = ctx;
+#ifdef LOGN
+    int order = 1;
+    while ((1ll << order) <= n)
+        order++;
+    dragon_getCoordN(&sink->x, &sink->y, order, (1ll << order) - 1);
+#else
+    dragon_getCoordN(&sink->x, &sink->y, 30, n);
+#endif
+}
+
+int main(void)
+{
+    struct Bench bench = BENCH_DEFAULT;
+    struct Sink sink;
+
+#ifdef LOGN
+    enum BigO bigO = benchClassify(&bench, runDragon, &sink, 2, 1ll << 60, 60, 1);
+    return benchCheck(bigO, O_LOGN, 1) == 0 ? 0 : 1;
+#else
+    return benchCheckExponent(&bench, runDragon, &sink, 10000, 1000000, 40, O_N, 1) == 0 ? 0 : 1;
+#endif
+}
@@ -27,22 +27,6 @@ enum Dir
 };
 
 
-/**
- * Number of vectors in a Heighway Dragon fractal depending on order.
- */
-static long long nbVector(int order)
-{
-    return 1ll << order;
-}
-
-/**
- * Number of vectors in a Heighway Dragon fractal depending on order.
- */
-static long long nbVector(int order)
-{
-    return 1ll << order;
-}
-
 /**
  * Mathematically:
  *   x = cos(order * PI / 4) * pow(sqrt(2), order)
@@ -186,6 +170,7 @@ int dragon_getCoordN(int *x, int *y, int order, long long nF)
     return -4;
 }
 
+#ifndef DRAGON_NO_MAIN
 int main(int argc, char **argv)
 {
     int x = 0, y = 0, ret;
@@ -217,4 +202,4 @@ int main(int argc, char **argv)
 
     return 0;
 }
-
+#endif // DRAGON_NO_MAIN
@@ -144,6 +144,7 @@ int dragon_getCoordN(int *x, int *y, int order, long long nF)
     return dragon_getCoordNStr(x, y, "Fa", &dir, order, &nF);
 }
 
+#ifndef DRAGON_NO_MAIN
 int main(int argc, char **argv)
 {
     int x = 0, y = 0, ret;
@@ -176,4 +177,4 @@ int main(int argc, char **argv)
 
     return 0;
 }
-
+#endif // DRAGON_NO_MAIN
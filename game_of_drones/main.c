@@ -2,6 +2,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
 /*
 
 gcc main.c -Wall -o game
@@ -21,25 +25,11 @@ void list_init(struct list *list)
     list->next = list->prev = list;
 }
 
-bool list_is_null_link(const struct list *list)
-{
-    return list->prev == NULL && list->next == NULL;
-}
-
 bool list_is_empty(const struct list *list)
 {
     return list->prev == list && list->next == list;
 }
 
-int list_nb_link(const struct list *list)
-{
-    int n = 0;
-    struct list *lnk;
-    for (lnk = list->next; lnk != list; lnk = lnk->next)
-        n++;
-    return n;
-}
-
 void list_add_next(struct list *list, struct list *link)
 {
     link->prev = list;
@@ -63,12 +53,6 @@ void list_del(struct list *link)
     link->next = link->prev = NULL;
 }
 
-void list_empty(struct list *list)
-{
-    while(!list_is_empty(list))
-        list_del(list->next);
-}
-
 #define list_walk_player_zones(player, zone) \
             for ((zone) = (struct zone *)(void *)(player)->list_ctrl_zones.next; \
                  (zone) != (struct zone *)(void *)&(player)->list_ctrl_zones; \
@@ -109,12 +93,6 @@ struct zone
     struct coord    coord;
     bool            targeted;
     int             nb_layer;
-    struct
-    {
-        int force[MAX_PLAYER];
-        int enemy_force;	// best enemy force
-        int target;		// nb of drones required to secure the layer
-    }               layers[MAX_LAYER];
     struct player   *ctrl_player;
 };
 
@@ -131,8 +109,79 @@ struct player
     int             id;
     struct drone    *drones;
     struct list     list_ctrl_zones; // list of zones controlled by player
+    int             nb_ctrl_zones;   // nb of links in list_ctrl_zones
     int             points;          // nb of points made so far
-    int             points_round;    // nb of points made in the round
+};
+
+/*
+ * Layer l of a zone holds the drones that reach it in l moves. The layer
+ * statistics are arrays indexed by zone then layer: the forces are kept
+ * from turn to turn and only updated for the drones that moved, the needs
+ * are rebuilt every turn after one memset.
+ */
+struct layer_force
+{
+    uint8_t         force[MAX_ZONE][MAX_LAYER][MAX_PLAYER];
+    uint8_t         drone_layer[MAX_ZONE][MAX_PLAYER * MAX_DRONE_PER_PLAYER];
+    struct coord    counted[MAX_PLAYER * MAX_DRONE_PER_PLAYER]; // coord of each drone in force
+    bool            ready;
+};
+
+/*
+ * Last TRACK_HISTORY positions of every drone, and the zone each enemy
+ * drone seems to head to. The projected forces are the layer forces where
+ * an enemy whose target is known only counts on that zone, a layer closer.
+ */
+#define TRACK_HISTORY   4
+
+struct track
+{
+    struct coord    history[TRACK_HISTORY][MAX_PLAYER * MAX_DRONE_PER_PLAYER];
+    int             nb_turn;    // positions recorded so far
+    int             target[MAX_PLAYER * MAX_DRONE_PER_PLAYER];  // zone, -1 if unknown
+    uint8_t         force[MAX_ZONE][MAX_LAYER][MAX_PLAYER];
+};
+
+struct layer_need
+{
+    int             enemy_force[MAX_ZONE][MAX_LAYER];   // best enemy force
+    int             target[MAX_ZONE][MAX_LAYER];        // nb of drones required to secure the layer
+};
+
+/*
+ * Time of each phase of the last TIMING_WINDOW turns, in us. The turn
+ * starts once the zone control is read, so it does not count the wait for
+ * the referee, and ends when the answer is flushed: clear_stat() runs after.
+ */
+#define TIMING_WINDOW   TURNS_PER_ROUND
+#define TURN_BUDGET_US  100000
+#define TURN_MARGIN_US  10000  // left for the output and the scheduling noise
+
+enum phase
+{
+    PHASE_READ = 0,
+    PHASE_STAT,
+    PHASE_MOVE,
+    PHASE_PLAN,
+    PHASE_TURN,
+    PHASE_CLEAR,
+    NB_PHASE
+};
+
+struct timing
+{
+    int64_t         sample[NB_PHASE][TIMING_WINDOW];
+    int             nb_turn;        // turns timed so far
+    int64_t         turn_start;
+    int64_t         phase_start;
+};
+
+// Budget of a search: it goes on while one more step, as long as the longest one so far, fits
+struct governor
+{
+    int64_t         deadline;
+    int64_t         step_start;
+    int64_t         step_max;
 };
 
 
@@ -147,6 +196,51 @@ int distance2(struct coord *c0, struct coord *c1)
     return dx * dx + dy * dy;
 }
 
+/* move a zone to the list of its controller, only when it changes hands */
+static void zone_set_ctrl(struct zone *zone, struct player *player)
+{
+    if (zone->ctrl_player == player)
+        return;
+    if (zone->ctrl_player != NULL)
+    {
+        list_del(&zone->link_player);
+        zone->ctrl_player->nb_ctrl_zones--;
+    }
+    zone->ctrl_player = player;
+    if (player != NULL)
+    {
+        list_add_prev(&player->list_ctrl_zones, &zone->link_player);
+        player->nb_ctrl_zones++;
+    }
+}
+
+/* integer square root, rounded down */
+static int isqrt(int n)
+{
+    int r = 0, b = 1 << 30;
+
+    while (b > n)
+        b >>= 2;
+    for (; b != 0; b >>= 2)
+    {
+        if (n >= r + b)
+        {
+            n -= r + b;
+            r = (r >> 1) + b;
+        }
+        else
+            r >>= 1;
+    }
+    return r;
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 
 /********************************* GLOBAL DATA ******************************/
 
@@ -156,11 +250,14 @@ int g_nb_zones;             // [4, 8]
 int g_nb_drones_per_player; // [3, 11]
 int g_nb_turns;
 int g_nb_rounds;
-int g_nb_target_zones;
 struct player *g_players;
 struct zone   *g_zones;
 struct drone  *g_drones;
 struct player *g_my_player;
+struct layer_force g_force;
+struct layer_need  g_need;
+struct track       g_track;
+struct timing      g_timing;
 
 /********************************* MAIN ******************************/
 
@@ -168,16 +265,25 @@ struct player *g_my_player;
 static void move_drones(void);
 static void make_stat(void);
 static void clear_stat(void);
-static void make_round_strategy(void);
-static void choose_nb_target_zone(void);
-
+static void choose_target_zones(void);
+static void plan_rollouts(void);
+static void track_record(void);
+static void track_project(void);
+static void timing_start_turn(void);
+static void timing_phase(enum phase phase);
+static void timing_end_turn(void);
+static bool read_int(int *value);
+static void write_targets(void);
+
+#ifndef DRONES_NO_MAIN
 int main(void)
 {
     int i, p;
 
     // Read init information from standard input
-    scanf("%d %d %d %d", &g_nb_players, &g_my_id,
-          &g_nb_drones_per_player, &g_nb_zones);
+    if (!read_int(&g_nb_players) || !read_int(&g_my_id) ||
+        !read_int(&g_nb_drones_per_player) || !read_int(&g_nb_zones))
+        return 1;
 
     g_players = calloc(1, sizeof(struct player) * g_nb_players);
     g_zones   = calloc(1, sizeof(struct zone)   * g_nb_zones);
@@ -200,207 +306,893 @@ int main(void)
     }
 
     for (i = 0; i < g_nb_zones; i++)
-        scanf("%d %d", &g_zones[i].coord.x, &g_zones[i].coord.y);
+        if (!read_int(&g_zones[i].coord.x) || !read_int(&g_zones[i].coord.y))
+            return 1;
 
     g_nb_turns = g_nb_rounds = 0;
-    make_round_strategy();
 
-    fprintf(stderr, "nz=%d np=%d ndpp=%d id=%d ntz=%d\n",
-            g_nb_zones, g_nb_players, g_nb_drones_per_player, g_my_id, g_nb_target_zones);
+    fprintf(stderr, "nz=%d np=%d ndpp=%d id=%d\n",
+            g_nb_zones, g_nb_players, g_nb_drones_per_player, g_my_id);
 
     while (1)
     {
-        // Read zone control
+        // Read zone control, the input ends with the game
         for (i = 0; i < g_nb_zones; i++)
         {
-            scanf("%d", &p);
-            if (p != -1)
-            {
-                g_zones[i].ctrl_player = &g_players[p];
-                list_add_next(&g_players[p].list_ctrl_zones, &g_zones[i].link_player);
-                g_players[p].points++;
-            }
-            else
-                g_zones[i].ctrl_player = NULL;
+            if (!read_int(&p))
+                return 0;
+            zone_set_ctrl(&g_zones[i], p != -1 ? &g_players[p] : NULL);
         }
+        // a point per zone controlled
+        for (i = 0; i < g_nb_players; i++)
+            g_players[i].points += g_players[i].nb_ctrl_zones;
+        timing_start_turn();
 
         // Read drones coords
         for (i = 0; i < g_nb_players * g_nb_drones_per_player; i++)
-            scanf("%d %d", &g_drones[i].coord.x, &g_drones[i].coord.y);
+            if (!read_int(&g_drones[i].coord.x) || !read_int(&g_drones[i].coord.y))
+                return 0;
+        track_record();
+        timing_phase(PHASE_READ);
 
         make_stat();
+        timing_phase(PHASE_STAT);
 
         // Compute logic here
         move_drones();
+        timing_phase(PHASE_MOVE);
+        plan_rollouts();
+        timing_phase(PHASE_PLAN);
 
         // Write action to standard output
-        for (i = 0; i < g_nb_drones_per_player; i++)
-        {
-            printf("%d %d\n",
-                   g_my_player->drones[i].target_coord.x,
-                   g_my_player->drones[i].target_coord.y);
-        }
+        write_targets();
+        timing_phase(PHASE_TURN);
 
         clear_stat();
+        timing_phase(PHASE_CLEAR);
+        timing_end_turn();
         g_nb_turns++;
-        if (g_nb_turns >= TURNS_PER_ROUND)
-        {
+        if (g_nb_turns % TURNS_PER_ROUND == 0)
             g_nb_rounds++;
-            make_round_strategy();
-        }
     }
 
     return 0;
 }
+#endif // DRONES_NO_MAIN
 
-static void make_round_strategy(void)
+/*
+ * Every STRATEGY_PERIOD turns, the targeted zones become the best of the
+ * 2^g_nb_zones subsets. Securing a zone takes one drone more than the best
+ * enemy force within STRATEGY_REACH layers, or as many if it is ours. Our
+ * drones are dealt to the zones of a subset nearest pair first, and each
+ * zone scores a point per turn of the STRATEGY_HORIZON left once its last
+ * drone arrives. A subset needing more drones than we have is out.
+ */
+#define STRATEGY_PERIOD     5
+#define STRATEGY_REACH      10
+#define STRATEGY_HORIZON    20
+#define STRATEGY_STICKY     3   // bonus of the current subset, so that it does not flap
+
+struct strategy_pair
 {
-    int p, z;
-    // recalculate the number of target zones
-    choose_nb_target_zone();
-
-    //xxx
-    for (z = 0; z < g_nb_target_zones; z++)
-        g_zones[z].targeted = true;
+    int             dist2;
+    int             layer;
+    int             d, z;
+};
 
-    for (p = 0; p < g_nb_players; p++)
-        g_players[p].points_round = 0;
+static int cmp_strategy_pair(const void *a, const void *b)
+{
+    return ((const struct strategy_pair *)a)->dist2 - ((const struct strategy_pair *)b)->dist2;
 }
 
-static void choose_nb_target_zone(void)
+static void choose_target_zones(void)
 {
-    g_nb_target_zones = g_nb_zones / 2 + 1;
+    struct strategy_pair pairs[MAX_ZONE * MAX_DRONE_PER_PLAYER];
+    int need[MAX_ZONE], left[MAX_ZONE], arrival[MAX_ZONE];
+    int n = g_nb_drones_per_player, nb_pair = 0;
+    int z, l, p, d, k, score, nb_left, best_score = -1;
+    unsigned mask, busy, cur_mask = 0, best_mask = 0;
+
+    for (z = 0; z < g_nb_zones; z++)
+    {
+        int enemy = 0;
+        for (p = 0; p < g_nb_players; p++)
+        {
+            int force = 0;
+            if (p == g_my_id)
+                continue;
+            for (l = 0; l < STRATEGY_REACH && l < MAX_LAYER; l++)
+                force += g_track.force[z][l][p];
+            if (force > enemy)
+                enemy = force;
+        }
+        need[z] = g_zones[z].ctrl_player == g_my_player ? enemy : enemy + 1;
+        if (g_zones[z].targeted)
+            cur_mask |= 1u << z;
+
+        for (d = 0; d < n; d++)
+        {
+            pairs[nb_pair].dist2 = distance2(&g_my_player->drones[d].coord, &g_zones[z].coord);
+            pairs[nb_pair].layer = g_force.drone_layer[z][g_my_id * n + d];
+            pairs[nb_pair].d = d;
+            pairs[nb_pair].z = z;
+            nb_pair++;
+        }
+    }
+    qsort(pairs, nb_pair, sizeof(struct strategy_pair), cmp_strategy_pair);
+
+    for (mask = 1; mask < 1u << g_nb_zones; mask++)
+    {
+        nb_left = 0;
+        for (z = 0; z < g_nb_zones; z++)
+        {
+            left[z] = mask >> z & 1 ? need[z] : 0;
+            arrival[z] = 0;
+            nb_left += left[z];
+        }
+        if (nb_left > n)
+            continue;
+
+        // the pairs are sorted, the last drone dealt to a zone is its farthest
+        busy = 0;
+        for (k = 0; k < nb_pair && nb_left > 0; k++)
+        {
+            if (left[pairs[k].z] == 0 || busy >> pairs[k].d & 1)
+                continue;
+            busy |= 1u << pairs[k].d;
+            left[pairs[k].z]--;
+            arrival[pairs[k].z] = pairs[k].layer;
+            nb_left--;
+        }
+
+        score = mask == cur_mask ? STRATEGY_STICKY : 0;
+        for (z = 0; z < g_nb_zones; z++)
+            if (mask >> z & 1 && arrival[z] < STRATEGY_HORIZON)
+                score += STRATEGY_HORIZON - arrival[z];
+        if (score > best_score)
+        {
+            best_score = score;
+            best_mask = mask;
+        }
+    }
+
+    // no zone can be secured: go for the least defended one
+    if (best_mask == 0)
+    {
+        for (z = 1, k = 0; z < g_nb_zones; z++)
+            if (need[z] < need[k])
+                k = z;
+        best_mask = 1u << k;
+    }
+
+    for (z = 0; z < g_nb_zones; z++)
+        g_zones[z].targeted = best_mask >> z & 1;
 }
 
-void find_layer_best_enemy_force(struct zone *zone, int layer)
+void find_layer_best_enemy_force(int z, int layer)
 {
     int p, max = 0;
 
     for (p = 0; p < g_nb_players; p++)
-        if (p != g_my_id && zone->layers[layer].force[p] > max)
-            max = zone->layers[layer].force[p];
+        if (p != g_my_id && g_track.force[z][layer][p] > max)
+            max = g_track.force[z][layer][p];
 
-    zone->layers[layer].enemy_force = max;
+    g_need.enemy_force[z][layer] = max;
 }
 
+/* smallest l such that dist2 <= (l * MAX_DIST)^2 */
 static int dist2_to_layer(int dist2)
 {
-    int l;
+    int dist = isqrt(dist2), l;
 
-    for (l = 0; l < MAX_LAYER; l++)
-        if ((uint64_t)dist2 <= (uint64_t)MAX_DIST2 * l * l)
-            return l;
+    // ceil(sqrt(dist2) / MAX_DIST), sqrt(dist2) being above dist if inexact
+    if (dist * dist == dist2)
+        l = (dist + MAX_DIST - 1) / MAX_DIST;
+    else
+        l = dist / MAX_DIST + 1;
 
-    return MAX_LAYER-1;
+    return l < MAX_LAYER ? l : MAX_LAYER - 1;
+}
+
+static void update_force(void)
+{
+    int d, z, l, p;
+
+    for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+    {
+        if (g_force.ready &&
+            g_force.counted[d].x == g_drones[d].coord.x &&
+            g_force.counted[d].y == g_drones[d].coord.y)
+            continue;
+        p = g_drones[d].player->id;
+        for (z = 0; z < g_nb_zones; z++)
+        {
+            l = dist2_to_layer(distance2(&g_drones[d].coord, &g_zones[z].coord));
+            if (g_force.ready)
+                g_force.force[z][g_force.drone_layer[z][d]][p]--;
+            g_force.force[z][l][p]++;
+            g_force.drone_layer[z][d] = l;
+        }
+        g_force.counted[d] = g_drones[d].coord;
+    }
+    g_force.ready = true;
 }
 
 static void make_stat(void)
 {
-    int d, z, p, dist2, l, max_l;
+    int d, z, l, max_l;
+
+    update_force();
+    track_project();
+    if (g_nb_turns % STRATEGY_PERIOD == 0)
+        choose_target_zones();
 
     for (z = 0; z < g_nb_zones; z++)
     {
         max_l = 0;
-        for (d = 0, p = 0; d < g_nb_players * g_nb_drones_per_player; d++)
-        {
-            if (d >= g_nb_drones_per_player * (p + 1))
-                p++;
-            dist2 = distance2(&g_drones[d].coord, &g_zones[z].coord);
-            l = dist2_to_layer(dist2);
-            if (l > max_l)
-                max_l = l;
-            g_zones[z].layers[l].force[p]++;
-            //fprintf(stderr, "Force++ for p=%d on z=%d at l=%d\n", p, z, l);
-        }
+        for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+            if (g_force.drone_layer[z][d] > max_l)
+                max_l = g_force.drone_layer[z][d];
         g_zones[z].nb_layer = max_l;
 
         // first layer target check
         if (!g_zones[z].targeted)
             continue;
 
-        find_layer_best_enemy_force(&g_zones[z], 0);
+        find_layer_best_enemy_force(z, 0);
 
         // if this zone is controlled by no-one, target it
         if (g_zones[z].ctrl_player == NULL)
-            g_zones[z].layers[0].target = 1;
+            g_need.target[z][0] = 1;
         else if (g_zones[z].ctrl_player != g_my_player)
-            g_zones[z].layers[0].target = g_zones[z].layers[0].enemy_force + 1;
+            g_need.target[z][0] = g_need.enemy_force[z][0] + 1;
         else
-            g_zones[z].layers[0].target = g_zones[z].layers[0].enemy_force;
+            g_need.target[z][0] = g_need.enemy_force[z][0];
 
         for (l = 1; l < g_zones[z].nb_layer; l++)
         {
-            find_layer_best_enemy_force(&g_zones[z], l);
+            find_layer_best_enemy_force(z, l);
 
-            if (g_zones[z].layers[l].enemy_force > 0)
-                g_zones[z].layers[l-1].target += g_zones[z].layers[l].enemy_force;
+            if (g_need.enemy_force[z][l] > 0)
+                g_need.target[z][l-1] += g_need.enemy_force[z][l];
         }
-
-        /*fprintf(stderr, "Enemy force=%d target=%d on z=%d (p=%d) at l=0\n",
-                g_zones[z].layers[0].enemy_force, g_zones[z].layers[0].target, z,
-                g_zones[z].ctrl_player == NULL ? -1 : g_zones[z].ctrl_player->id);*/
     }
 }
 
 static void clear_stat(void)
 {
-    int p, z, d, l;
-
-    for (z = 0; z < g_nb_zones; z++)
-        for (l = 0; l < MAX_LAYER; l++)
-        {
-            for (p = 0; p < g_nb_players; p++)
-                g_zones[z].layers[l].force[p] = 0;
-            g_zones[z].layers[l].enemy_force = 0;
-            g_zones[z].layers[l].target = 0;
-        }
+    int d;
 
-    for (p = 0; p < g_nb_players; p++)
-        list_empty(&g_players[p].list_ctrl_zones);
+    memset(&g_need, 0x0, sizeof(struct layer_need));
     for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
         g_drones[d].ctrl_zone = NULL;
     for (d = 0; d < g_nb_drones_per_player; d++)
         g_my_player->drones[d].target_coord = g_my_player->drones[d].coord;
 }
 
-static void move_drones(void)
-{
-    int d, z, layer, dist2, dist2_to_target;
-    struct zone *targeted_zone;
+/********************************* ASSIGNMENT ******************************/
 
-    layer = 0;
+/*
+ * Drones are matched to slots: a slot is one of the drones required by
+ * g_need.target[z][l] of a targeted zone. The cost of a slot is the distance
+ * to the zone plus SLOT_LAYER_COST per layer, so that the lower layers are
+ * filled first, as the former greedy did, but with the smallest total
+ * distance. Drones left over go to a spare slot on the nearest targeted
+ * zone.
+ */
+#define SLOT_LAYER_COST (MAX_X + MAX_Y)
+#define SPARE_COST      (SLOT_LAYER_COST * MAX_LAYER)
+#define MAX_SLOT        ((MAX_ZONE + 2) * MAX_DRONE_PER_PLAYER)
+#define INF_COST        0x3fffffff
+
+struct slot
+{
+    struct zone *zone;
+    int         layer;  // -1 for a spare slot
+};
 
-    for (d = 0; d < g_nb_drones_per_player; d++)
+/*
+ * Hungarian algorithm for the nb_row x nb_col cost matrix, nb_row <=
+ * nb_col, in O(nb_row^2 * nb_col). row_col[r] is set to the column of row r.
+ */
+static void hungarian(int cost[][MAX_SLOT], int nb_row, int nb_col, int *row_col)
+{
+    // 1-indexed, column 0 is the row being added
+    int u[MAX_DRONE_PER_PLAYER + 1], v[MAX_SLOT + 1];
+    int col_row[MAX_SLOT + 1], way[MAX_SLOT + 1], minv[MAX_SLOT + 1];
+    bool used[MAX_SLOT + 1];
+    int r, c, c0, c1, delta;
+
+    for (r = 0; r <= nb_row; r++)
+        u[r] = 0;
+    for (c = 0; c <= nb_col; c++)
+        v[c] = col_row[c] = 0;
+
+    for (r = 1; r <= nb_row; r++)
     {
-        targeted_zone = NULL;
-        dist2_to_target = BIGGEST_DIST2;
+        col_row[0] = r;
+        c0 = 0;
+        for (c = 0; c <= nb_col; c++)
+        {
+            minv[c] = INF_COST;
+            used[c] = false;
+        }
+        do
+        {
+            int r0 = col_row[c0];
+            used[c0] = true;
+            delta = INF_COST;
+            c1 = 0;
+            for (c = 1; c <= nb_col; c++)
+            {
+                if (used[c])
+                    continue;
+                int cur = cost[r0 - 1][c - 1] - u[r0] - v[c];
+                if (cur < minv[c])
+                {
+                    minv[c] = cur;
+                    way[c] = c0;
+                }
+                if (minv[c] < delta)
+                {
+                    delta = minv[c];
+                    c1 = c;
+                }
+            }
+            for (c = 0; c <= nb_col; c++)
+            {
+                if (used[c])
+                {
+                    u[col_row[c]] += delta;
+                    v[c] -= delta;
+                }
+                else
+                    minv[c] -= delta;
+            }
+            c0 = c1;
+        } while (col_row[c0] != 0);
+        // augment along the path
+        do
+        {
+            c1 = way[c0];
+            col_row[c0] = col_row[c1];
+            c0 = c1;
+        } while (c0 != 0);
+    }
 
-next_layer:
+    for (c = 1; c <= nb_col; c++)
+        if (col_row[c] != 0)
+            row_col[col_row[c] - 1] = c - 1;
+}
+
+static void move_drones(void)
+{
+    static int cost[MAX_DRONE_PER_PLAYER][MAX_SLOT];
+    struct slot slots[MAX_SLOT];
+    struct zone *spare_zone[MAX_DRONE_PER_PLAYER];
+    int row_col[MAX_DRONE_PER_PLAYER];
+    int n = g_nb_drones_per_player;
+    int nb_slot = 0, d, z, l, k, s;
+
+    // Slots of the lowest layers, until there are enough for all drones
+    for (l = 0; l < MAX_LAYER && nb_slot < n; l++)
         for (z = 0; z < g_nb_zones; z++)
         {
-            if (!g_zones[z].targeted || g_zones[z].nb_layer < layer)
+            if (!g_zones[z].targeted || g_zones[z].nb_layer < l)
                 continue;
-            // if it requires a target, check its distance
-            if (g_zones[z].layers[layer].target > 0)
+            for (k = 0; k < g_need.target[z][l] && k < n; k++)
             {
-                dist2 = distance2(&g_my_player->drones[d].coord, &g_zones[z].coord);
-                if (dist2 < dist2_to_target)
-                {
-                    dist2_to_target = dist2;
-                    targeted_zone = &g_zones[z];
-                }
+                slots[nb_slot].zone = &g_zones[z];
+                slots[nb_slot].layer = l;
+                nb_slot++;
+            }
+        }
+    for (d = 0; d < n; d++)
+    {
+        slots[nb_slot].zone = NULL;
+        slots[nb_slot].layer = -1;
+        nb_slot++;
+    }
+
+    for (d = 0; d < n; d++)
+    {
+        struct drone *drone = &g_my_player->drones[d];
+        int spare = INF_COST;
+
+        spare_zone[d] = NULL;
+        for (z = 0; z < g_nb_zones; z++)
+            if (g_zones[z].targeted &&
+                isqrt(distance2(&drone->coord, &g_zones[z].coord)) < spare)
+            {
+                spare = isqrt(distance2(&drone->coord, &g_zones[z].coord));
+                spare_zone[d] = &g_zones[z];
             }
+
+        for (s = 0; s < nb_slot; s++)
+        {
+            if (slots[s].layer >= 0)
+                cost[d][s] = isqrt(distance2(&drone->coord, &slots[s].zone->coord)) +
+                             slots[s].layer * SLOT_LAYER_COST;
+            else
+                cost[d][s] = SPARE_COST + (spare_zone[d] != NULL ? spare : 0);
         }
-        // if no target found, try next layer
-        if (targeted_zone == NULL)
+    }
+
+    hungarian(cost, n, nb_slot, row_col);
+
+    for (d = 0; d < n; d++)
+    {
+        struct drone *drone = &g_my_player->drones[d];
+        struct slot *slot = &slots[row_col[d]];
+
+        if (slot->layer >= 0)
         {
-            layer++;
-            goto next_layer;
+            drone->target_coord = slot->zone->coord;
+            g_need.target[slot->zone - g_zones][slot->layer]--;
         }
+        else if (spare_zone[d] != NULL)
+            drone->target_coord = spare_zone[d]->coord;
         else
+            drone->target_coord = drone->coord;
+    }
+}
+
+/********************************* SIMULATION ******************************/
+
+/*
+ * Allocation-free forward model: drones fly at most MAX_DIST toward their
+ * target, a zone goes to the player with strictly the most drones within
+ * ZONE_RADIUS (a tie keeps the controller), and each controlled zone gives
+ * a point to its controller every turn.
+ */
+struct sim
+{
+    struct drone    drones[MAX_PLAYER * MAX_DRONE_PER_PLAYER];
+    int             ctrl[MAX_ZONE];     // controller id, -1 if none
+    int             points[MAX_PLAYER];
+};
+
+static void sim_init(struct sim *sim)
+{
+    int d, z;
+
+    for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+    {
+        sim->drones[d].coord = sim->drones[d].target_coord = g_drones[d].coord;
+        sim->drones[d].player = g_drones[d].player;
+        sim->drones[d].ctrl_zone = NULL;
+    }
+    for (z = 0; z < g_nb_zones; z++)
+        sim->ctrl[z] = g_zones[z].ctrl_player != NULL ? g_zones[z].ctrl_player->id : -1;
+    for (d = 0; d < g_nb_players; d++)
+        sim->points[d] = 0;
+}
+
+static void sim_move(struct drone *drone)
+{
+    int dx = drone->target_coord.x - drone->coord.x;
+    int dy = drone->target_coord.y - drone->coord.y;
+    int dist2 = dx * dx + dy * dy, dist;
+
+    if (dist2 <= MAX_DIST2)
+    {
+        drone->coord = drone->target_coord;
+        return;
+    }
+    dist = isqrt(dist2);
+    drone->coord.x += dx * MAX_DIST / dist;
+    drone->coord.y += dy * MAX_DIST / dist;
+}
+
+static void sim_turn(struct sim *sim)
+{
+    int force[MAX_PLAYER];
+    int d, z, p, best, nb_best;
+
+    for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+        sim_move(&sim->drones[d]);
+
+    for (z = 0; z < g_nb_zones; z++)
+    {
+        for (p = 0; p < g_nb_players; p++)
+            force[p] = 0;
+        for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+            if (distance2(&sim->drones[d].coord, &g_zones[z].coord) <= ZONE_RADIUS2)
+                force[sim->drones[d].player->id]++;
+
+        best = -1;
+        nb_best = 0;
+        for (p = 0; p < g_nb_players; p++)
+        {
+            if (best < 0 || force[p] > force[best])
+            {
+                best = p;
+                nb_best = 1;
+            }
+            else if (force[p] == force[best])
+                nb_best++;
+        }
+        if (force[best] > 0 && nb_best == 1)
+            sim->ctrl[z] = best;
+        if (sim->ctrl[z] >= 0)
+            sim->points[sim->ctrl[z]]++;
+    }
+}
+
+/********************************* TIMING ******************************/
+
+static const char *g_phase_name[NB_PHASE] = {"read", "stat", "move", "plan", "turn", "clear"};
+
+static void timing_start_turn(void)
+{
+    g_timing.turn_start = g_timing.phase_start = now_us();
+}
+
+// End the phase started by the previous call, the turn phase spans from its start
+static void timing_phase(enum phase phase)
+{
+    int64_t now = now_us();
+    int64_t start = phase == PHASE_TURN ? g_timing.turn_start : g_timing.phase_start;
+
+    g_timing.sample[phase][g_timing.nb_turn % TIMING_WINDOW] = now - start;
+    g_timing.phase_start = now;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Rolling p50/p99 of every phase, once a round
+static void timing_end_turn(void)
+{
+    int64_t sorted[TIMING_WINDOW];
+    int phase, n;
+
+    g_timing.nb_turn++;
+    if (g_timing.nb_turn % TURNS_PER_ROUND != 0)
+        return;
+
+    n = g_timing.nb_turn < TIMING_WINDOW ? g_timing.nb_turn : TIMING_WINDOW;
+    fprintf(stderr, "time:");
+    for (phase = 0; phase < NB_PHASE; phase++)
+    {
+        memcpy(sorted, g_timing.sample[phase], n * sizeof(int64_t));
+        qsort(sorted, n, sizeof(int64_t), cmp_int64);
+        fprintf(stderr, " %s %lld/%lldus", g_phase_name[phase],
+                (long long)sorted[n / 2], (long long)sorted[(n * 99) / 100]);
+    }
+    fprintf(stderr, "\n");
+}
+
+// Give a search budget_us, or less if the turn would not end in time
+static void gov_init(struct governor *gov, int64_t budget_us)
+{
+    int64_t now = now_us();
+    int64_t turn_end = g_timing.turn_start + TURN_BUDGET_US - TURN_MARGIN_US;
+
+    gov->deadline = now + budget_us;
+    if (g_timing.turn_start != 0 && turn_end < gov->deadline)
+        gov->deadline = turn_end;
+    gov->step_start = now;
+    gov->step_max = 0;
+}
+
+// End the current step, and tell whether the next one fits before the deadline
+static bool gov_next(struct governor *gov)
+{
+    int64_t now = now_us();
+
+    if (now - gov->step_start > gov->step_max)
+        gov->step_max = now - gov->step_start;
+    gov->step_start = now;
+    return now + gov->step_max < gov->deadline;
+}
+
+/********************************* ROLLOUT ******************************/
+
+/*
+ * Monte Carlo planner on top of the assignment: a candidate gives a zone
+ * (or -1 to stay) to each of our drones, and is played for PLAN_TURNS turns
+ * against enemies flying to their nearest zone, or with PLAN_NOISE chances
+ * out of 256 to a random one. Every candidate meets the same PLAN_ROLLOUTS
+ * enemy draws. Candidates are mutations of the best one so far, starting
+ * from the assignment, while the governor lets another one in.
+ */
+#define PLAN_BUDGET_US  40000
+#define PLAN_TURNS      20
+#define PLAN_ROLLOUTS   4
+#define PLAN_NOISE      64
+
+static uint32_t g_rand_state = 2463534242u;
+
+static uint32_t rand_next(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static int nearest_zone(struct coord *coord)
+{
+    int z, best = 0;
+
+    for (z = 1; z < g_nb_zones; z++)
+        if (distance2(coord, &g_zones[z].coord) < distance2(coord, &g_zones[best].coord))
+            best = z;
+    return best;
+}
+
+// Sum over the rollouts of our points minus the best enemy's
+static int plan_evaluate(const struct sim *start, const int *zone_of)
+{
+    static struct sim sim;
+    int r, t, d, p, score = 0;
+
+    for (r = 0; r < PLAN_ROLLOUTS; r++)
+    {
+        uint32_t state = 0x9e3779b9u * (r + 1) + g_nb_turns;
+
+        sim = *start;
+        for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+        {
+            struct drone *drone = &sim.drones[d];
+            if (drone->player == g_my_player)
+            {
+                int z = zone_of[d - g_my_id * g_nb_drones_per_player];
+                drone->target_coord = z >= 0 ? g_zones[z].coord : drone->coord;
+            }
+            else if ((rand_next(&state) & 0xff) < PLAN_NOISE)
+                drone->target_coord = g_zones[rand_next(&state) % g_nb_zones].coord;
+            else
+                drone->target_coord = g_zones[nearest_zone(&drone->coord)].coord;
+        }
+
+        for (t = 0; t < PLAN_TURNS; t++)
+            sim_turn(&sim);
+
+        int enemy = 0;
+        for (p = 0; p < g_nb_players; p++)
+            if (p != g_my_id && sim.points[p] > enemy)
+                enemy = sim.points[p];
+        score += sim.points[g_my_id] - enemy;
+    }
+    return score;
+}
+
+static void plan_rollouts(void)
+{
+    static struct sim start;
+    int best_zone[MAX_DRONE_PER_PLAYER], zone_of[MAX_DRONE_PER_PLAYER];
+    struct governor gov;
+    int n = g_nb_drones_per_player;
+    int d, z, k, score, best_score;
+
+    gov_init(&gov, PLAN_BUDGET_US);
+    sim_init(&start);
+
+    // the assignment is the first candidate
+    for (d = 0; d < n; d++)
+    {
+        best_zone[d] = -1;
+        for (z = 0; z < g_nb_zones; z++)
+            if (g_my_player->drones[d].target_coord.x == g_zones[z].coord.x &&
+                g_my_player->drones[d].target_coord.y == g_zones[z].coord.y)
+                best_zone[d] = z;
+    }
+    best_score = plan_evaluate(&start, best_zone);
+
+    while (gov_next(&gov))
+    {
+        for (d = 0; d < n; d++)
+            zone_of[d] = best_zone[d];
+        for (k = rand_next(&g_rand_state) % 2; k >= 0; k--)
+            zone_of[rand_next(&g_rand_state) % n] = rand_next(&g_rand_state) % g_nb_zones;
+
+        score = plan_evaluate(&start, zone_of);
+        if (score > best_score)
         {
-            g_my_player->drones[d].target_coord = targeted_zone->coord;
-            targeted_zone->layers[layer].target--;
+            best_score = score;
+            for (d = 0; d < n; d++)
+                best_zone[d] = zone_of[d];
         }
     }
+
+    for (d = 0; d < n; d++)
+        if (best_zone[d] >= 0)
+            g_my_player->drones[d].target_coord = g_zones[best_zone[d]].coord;
+}
+
+/********************************* TRACKER ******************************/
+
+#define TRACK_STRAIGHT2 (MAX_DIST2 / 100)   // tolerance of |move x heading| / |heading|
+
+static struct coord *track_pos(int age, int d)
+{
+    return &g_track.history[(g_track.nb_turn - 1 - age) % TRACK_HISTORY][d];
+}
+
+static void track_record(void)
+{
+    int d;
+
+    for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+        g_track.history[g_track.nb_turn % TRACK_HISTORY][d] = g_drones[d].coord;
+    g_track.nb_turn++;
+}
+
+/*
+ * Zone an enemy drone heads to: its heading is its last move, extended back
+ * while the former moves go the same way. The zone is the one closest to
+ * that line ahead of the drone, within ZONE_RADIUS. A drone that does not
+ * move holds the zone it is in.
+ */
+static int track_guess_target(int d)
+{
+    struct coord *cur = track_pos(0, d), *from;
+    int64_t vx, vy, v2, best_perp2 = -1;
+    int age, z, best = -1;
+
+    if (g_track.nb_turn < 2)
+        return -1;
+    from = track_pos(1, d);
+    vx = cur->x - from->x;
+    vy = cur->y - from->y;
+
+    if (vx == 0 && vy == 0)
+    {
+        for (z = 0; z < g_nb_zones; z++)
+            if (distance2(cur, &g_zones[z].coord) <= ZONE_RADIUS2)
+                return z;
+        return -1;
+    }
+
+    for (age = 2; age < TRACK_HISTORY && age < g_track.nb_turn; age++)
+    {
+        struct coord *prev = track_pos(age, d);
+        int64_t mx = from->x - prev->x, my = from->y - prev->y;
+        int64_t cross = mx * vy - my * vx;
+        if (mx * vx + my * vy <= 0 ||
+            cross * cross > TRACK_STRAIGHT2 * (vx * vx + vy * vy))
+            break;
+        from = prev;
+    }
+    vx = cur->x - from->x;
+    vy = cur->y - from->y;
+    v2 = vx * vx + vy * vy;
+
+    for (z = 0; z < g_nb_zones; z++)
+    {
+        int64_t wx = g_zones[z].coord.x - cur->x, wy = g_zones[z].coord.y - cur->y;
+        int64_t cross = vx * wy - vy * wx;
+        // squared distance from the zone to the line, times v2
+        int64_t perp2 = cross * cross;
+        if (vx * wx + vy * wy < 0 || perp2 > ZONE_RADIUS2 * v2)
+            continue;
+        if (best < 0 || perp2 < best_perp2 ||
+            (perp2 == best_perp2 &&
+             distance2(cur, &g_zones[z].coord) < distance2(cur, &g_zones[best].coord)))
+        {
+            best = z;
+            best_perp2 = perp2;
+        }
+    }
+    return best;
+}
+
+static void track_project(void)
+{
+    int d, z, p;
+
+    memcpy(g_track.force, g_force.force, sizeof(g_track.force));
+    for (d = 0; d < g_nb_players * g_nb_drones_per_player; d++)
+    {
+        p = g_drones[d].player->id;
+        g_track.target[d] = p == g_my_id ? -1 : track_guess_target(d);
+        if (g_track.target[d] < 0)
+            continue;
+        for (z = 0; z < g_nb_zones; z++)
+            if (z != g_track.target[d])
+                g_track.force[z][g_force.drone_layer[z][d]][p]--;
+        // and is one move closer when ours arrive
+        z = g_track.target[d];
+        if (g_force.drone_layer[z][d] > 0)
+        {
+            g_track.force[z][g_force.drone_layer[z][d]][p]--;
+            g_track.force[z][g_force.drone_layer[z][d] - 1][p]++;
+        }
+    }
+}
+
+/********************************* IO ******************************/
+
+/*
+ * The turns are read from fd 0 through one buffer and parsed by hand, and
+ * the answer of a turn goes out in a single write(): one scanf() or
+ * printf() per number costs more than the stats and the assignment.
+ */
+struct input
+{
+    char            buf[4096];
+    int             pos, len;
+};
+
+static struct input g_input;
+
+static int read_char(void)
+{
+    if (g_input.pos == g_input.len)
+    {
+        ssize_t n;
+        do
+            n = read(0, g_input.buf, sizeof(g_input.buf));
+        while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return EOF;
+        g_input.pos = 0;
+        g_input.len = n;
+    }
+    return g_input.buf[g_input.pos++];
+}
+
+// Read the next integer, false at the end of the input
+static bool read_int(int *value)
+{
+    int c, sign = 1;
+
+    do
+        c = read_char();
+    while (c != EOF && c != '-' && (c < '0' || c > '9'));
+    if (c == EOF)
+        return false;
+    if (c == '-')
+    {
+        sign = -1;
+        c = read_char();
+    }
+    for (*value = 0; c >= '0' && c <= '9'; c = read_char())
+        *value = *value * 10 + c - '0';
+    *value *= sign;
+    return true;
+}
+
+static char *write_int(char *out, int value)
+{
+    char digits[12];
+    int n = 0;
+    unsigned u = value < 0 ? -(unsigned)value : (unsigned)value;
+
+    if (value < 0)
+        *out++ = '-';
+    do
+        digits[n++] = '0' + u % 10;
+    while ((u /= 10) != 0);
+    while (n > 0)
+        *out++ = digits[--n];
+    return out;
+}
+
+static void write_targets(void)
+{
+    char buf[MAX_DRONE_PER_PLAYER * 24], *out = buf, *p;
+    int d;
+
+    for (d = 0; d < g_nb_drones_per_player; d++)
+    {
+        out = write_int(out, g_my_player->drones[d].target_coord.x);
+        *out++ = ' ';
+        out = write_int(out, g_my_player->drones[d].target_coord.y);
+        *out++ = '\n';
+    }
+    for (p = buf; p < out; )
+    {
+        ssize_t n = write(1, p, out - p);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        p += n;
+    }
 }
@@ -0,0 +1,451 @@
+#define _GNU_SOURCE     // pipe2()
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+/*
+
+gcc referee.c -Wall -O2 -o referee
+
+Local referee for game_of_drones bots:
+
+    ./referee [-n matches] [-s seed] [-j jobs] [-t timeout ms] [-r replay dir] [-v] bot0 bot1 [bot2 [bot3]]
+
+Each bot is a shell command, run once per match with its stdin and stdout
+on pipes. Match i is generated from seed + i, and the bots take turns in
+the seats so that no bot keeps the same one. Matches are spread over
+`jobs` processes. At the end, it prints for each bot its wins, points and
+the percentiles of its decision time (from the turn input being written to
+its last line being read).
+
+The rules are the ones of the bot's simulator: the constants, sim_move()
+and sim_turn() come from main.c. A bot that times out or writes a bad
+line is out: its drones stay where they are until the end.
+
+*/
+
+// The rules and the simulator are reused, not the turn logic of the bot
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#define DRONES_NO_MAIN
+#include "main.c"
+#pragma GCC diagnostic pop
+
+#define REF_NB_TURN         (4 * TURNS_PER_ROUND)
+#define REF_FIRST_TIMEOUT   1000            // ms, for the first turn
+#define REF_HIST_US         100             // latency histogram resolution
+#define REF_HIST_SIZE       20000           // up to 2s
+#define REF_LINE            64
+
+/********************************* TYPEDEF ******************************/
+
+struct bot
+{
+    const char  *cmd;
+    pid_t       pid;
+    int         fd_in, fd_out;          // its stdin and stdout
+    char        buf[4096];
+    int         len;
+    bool        out;                    // timed out or bad output
+};
+
+// Shared between the jobs, updated with atomics
+struct result
+{
+    long        nb_match;
+    long        wins[MAX_PLAYER];
+    long        draws[MAX_PLAYER];
+    long        points[MAX_PLAYER];
+    long        failures[MAX_PLAYER];
+    uint32_t    hist[MAX_PLAYER][REF_HIST_SIZE];
+};
+
+struct arena
+{
+    const char      *cmds[MAX_PLAYER];
+    int             nb_bot;
+    int             timeout;            // ms
+    const char      *replay_dir;
+    bool            verbose;
+    struct result   *result;
+};
+
+/********************************* BOTS ******************************/
+
+static int bot_start(struct bot *bot, const char *cmd, bool verbose)
+{
+    int to_bot[2], from_bot[2];
+
+    bot->cmd = cmd;
+    bot->pid = -1;
+    bot->fd_in = bot->fd_out = -1;
+    bot->len = 0;
+    bot->out = false;
+    // close-on-exec, so that no bot gets the pipes of the others
+    if (pipe2(to_bot, O_CLOEXEC) != 0)
+        return -1;
+    if (pipe2(from_bot, O_CLOEXEC) != 0)
+    {
+        close(to_bot[0]);
+        close(to_bot[1]);
+        return -1;
+    }
+
+    bot->pid = fork();
+    if (bot->pid < 0)
+    {
+        close(to_bot[0]);
+        close(to_bot[1]);
+        close(from_bot[0]);
+        close(from_bot[1]);
+        return -2;
+    }
+    if (bot->pid == 0)
+    {
+        char sh_cmd[1024];
+        // dup2() clears close-on-exec on 0, 1 and 2, the rest goes with exec
+        dup2(to_bot[0], 0);
+        dup2(from_bot[1], 1);
+        if (!verbose)
+        {
+            int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+            dup2(null, 2);
+        }
+        snprintf(sh_cmd, sizeof(sh_cmd), "exec %s", cmd);
+        execl("/bin/sh", "sh", "-c", sh_cmd, (char *)NULL);
+        _exit(127);
+    }
+
+    close(to_bot[0]);
+    close(from_bot[1]);
+    bot->fd_in = to_bot[1];
+    bot->fd_out = from_bot[0];
+    return 0;
+}
+
+static void bot_stop(struct bot *bot)
+{
+    if (bot->pid <= 0)
+        return;
+    close(bot->fd_in);
+    close(bot->fd_out);
+    kill(bot->pid, SIGKILL);
+    waitpid(bot->pid, NULL, 0);
+}
+
+static int bot_write(struct bot *bot, const char *data, int len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(bot->fd_in, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Read a line before the deadline (in us); return its length or -1
+static int bot_read_line(struct bot *bot, char *line, int64_t deadline)
+{
+    while (1)
+    {
+        char *eol = memchr(bot->buf, '\n', bot->len);
+        if (eol != NULL)
+        {
+            int len = eol - bot->buf;
+            if (len >= REF_LINE)
+                return -1;
+            memcpy(line, bot->buf, len);
+            line[len] = '\0';
+            bot->len -= len + 1;
+            memmove(bot->buf, eol + 1, bot->len);
+            return len;
+        }
+        if (bot->len == sizeof(bot->buf))
+            return -1;
+
+        int64_t left = deadline - now_us();
+        struct pollfd pfd = {bot->fd_out, POLLIN, 0};
+        if (left <= 0 || poll(&pfd, 1, (left + 999) / 1000) <= 0)
+            return -1;
+        ssize_t n = read(bot->fd_out, bot->buf + bot->len, sizeof(bot->buf) - bot->len);
+        if (n <= 0)
+            return -1;
+        bot->len += n;
+    }
+}
+
+/********************************* MATCH ******************************/
+
+static void result_add(long *counter, long n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void result_latency(struct result *result, int b, int64_t us)
+{
+    int64_t bucket = us / REF_HIST_US;
+    if (bucket >= REF_HIST_SIZE)
+        bucket = REF_HIST_SIZE - 1;
+    __atomic_fetch_add(&result->hist[b][bucket], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Play match `match`: the bot of seat s is bot (s + match) % nb_bot. The
+ * map is set in the bot globals that sim_turn() reads.
+ */
+static void play_match(struct arena *arena, uint32_t seed, long match)
+{
+    static struct player players[MAX_PLAYER];
+    static struct zone zones[MAX_ZONE];
+    static struct sim sim;
+    static char msg[4096];
+    struct bot bots[MAX_PLAYER];
+    uint32_t state = seed * 2654435761u + 1;
+    int nb_drone, s, d, z, t, len, best, nb_best;
+    FILE *replay = NULL;
+
+    g_nb_players = arena->nb_bot;
+    g_nb_drones_per_player = 3 + rand_next(&state) % (MAX_DRONE_PER_PLAYER - 2);
+    g_nb_zones = 4 + rand_next(&state) % (MAX_ZONE - 3);
+    g_players = players;
+    g_zones = zones;
+    nb_drone = g_nb_players * g_nb_drones_per_player;
+
+    for (z = 0; z < g_nb_zones; z++)
+    {
+        zones[z].coord.x = ZONE_RADIUS + rand_next(&state) % (MAX_X - 2 * ZONE_RADIUS);
+        zones[z].coord.y = ZONE_RADIUS + rand_next(&state) % (MAX_Y - 2 * ZONE_RADIUS);
+        sim.ctrl[z] = -1;
+    }
+    for (s = 0; s < g_nb_players; s++)
+    {
+        players[s].id = s;
+        sim.points[s] = 0;
+    }
+    for (d = 0; d < nb_drone; d++)
+    {
+        sim.drones[d].coord.x = rand_next(&state) % MAX_X;
+        sim.drones[d].coord.y = rand_next(&state) % MAX_Y;
+        sim.drones[d].target_coord = sim.drones[d].coord;
+        sim.drones[d].player = &players[d / g_nb_drones_per_player];
+    }
+
+    if (arena->replay_dir != NULL)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/match_%u.txt", arena->replay_dir, seed);
+        replay = fopen(path, "w");
+    }
+    if (replay != NULL)
+    {
+        fprintf(replay, "%d %d %d\n", g_nb_players, g_nb_drones_per_player, g_nb_zones);
+        for (s = 0; s < g_nb_players; s++)
+            fprintf(replay, "%s\n", arena->cmds[(s + match) % arena->nb_bot]);
+        for (z = 0; z < g_nb_zones; z++)
+            fprintf(replay, "%d %d\n", zones[z].coord.x, zones[z].coord.y);
+    }
+
+    for (s = 0; s < g_nb_players; s++)
+    {
+        int b = (s + match) % arena->nb_bot;
+        if (bot_start(&bots[s], arena->cmds[b], arena->verbose) != 0)
+        {
+            bots[s].out = true;
+            result_add(&arena->result->failures[b], 1);
+            continue;
+        }
+        len = snprintf(msg, sizeof(msg), "%d %d %d %d\n", g_nb_players, s,
+                       g_nb_drones_per_player, g_nb_zones);
+        for (z = 0; z < g_nb_zones; z++)
+            len += snprintf(msg + len, sizeof(msg) - len, "%d %d\n",
+                            zones[z].coord.x, zones[z].coord.y);
+        // a failed write shows up again, and is counted, at the first turn
+        bot_write(&bots[s], msg, len);
+    }
+
+    for (t = 0; t < REF_NB_TURN; t++)
+    {
+        len = 0;
+        for (z = 0; z < g_nb_zones; z++)
+            len += snprintf(msg + len, sizeof(msg) - len, "%d\n", sim.ctrl[z]);
+        for (d = 0; d < nb_drone; d++)
+            len += snprintf(msg + len, sizeof(msg) - len, "%d %d\n",
+                            sim.drones[d].coord.x, sim.drones[d].coord.y);
+        if (replay != NULL)
+            fwrite(msg, 1, len, replay);
+
+        for (s = 0; s < g_nb_players; s++)
+        {
+            struct bot *bot = &bots[s];
+            int b = (s + match) % arena->nb_bot;
+            int64_t start = now_us();
+            int64_t deadline = start + 1000 * (t == 0 ? REF_FIRST_TIMEOUT : arena->timeout);
+            char line[REF_LINE];
+
+            if (bot->out)
+                continue;
+            bool failed = bot_write(bot, msg, len) != 0;
+            for (d = 0; d < g_nb_drones_per_player && !failed; d++)
+            {
+                struct drone *drone = &sim.drones[s * g_nb_drones_per_player + d];
+                failed = bot_read_line(bot, line, deadline) < 0 ||
+                         sscanf(line, "%d %d", &drone->target_coord.x, &drone->target_coord.y) != 2;
+            }
+            if (failed)
+            {
+                if (arena->verbose)
+                    fprintf(stderr, "match %u: %s out at turn %d\n", seed, bot->cmd, t);
+                bot->out = true;
+                result_add(&arena->result->failures[b], 1);
+                // its drones stay
+                for (d = 0; d < g_nb_drones_per_player; d++)
+                {
+                    struct drone *drone = &sim.drones[s * g_nb_drones_per_player + d];
+                    drone->target_coord = drone->coord;
+                }
+                continue;
+            }
+            result_latency(arena->result, b, now_us() - start);
+        }
+
+        sim_turn(&sim);
+    }
+
+    best = 0;
+    nb_best = 0;
+    for (s = 0; s < g_nb_players; s++)
+    {
+        int b = (s + match) % arena->nb_bot;
+        result_add(&arena->result->points[b], sim.points[s]);
+        if (sim.points[s] > sim.points[best])
+        {
+            best = s;
+            nb_best = 1;
+        }
+        else if (sim.points[s] == sim.points[best])
+            nb_best++;
+        bot_stop(&bots[s]);
+    }
+    for (s = 0; s < g_nb_players; s++)
+        if (sim.points[s] == sim.points[best])
+            result_add(nb_best == 1 ? &arena->result->wins[(s + match) % arena->nb_bot] :
+                                      &arena->result->draws[(s + match) % arena->nb_bot], 1);
+    result_add(&arena->result->nb_match, 1);
+
+    if (replay != NULL)
+    {
+        for (s = 0; s < g_nb_players; s++)
+            fprintf(replay, "%d%c", sim.points[s], s + 1 < g_nb_players ? ' ' : '\n');
+        fclose(replay);
+    }
+}
+
+/********************************* REPORT ******************************/
+
+static double percentile(const uint32_t *hist, double pct)
+{
+    uint64_t total = 0, seen = 0;
+    int i;
+
+    for (i = 0; i < REF_HIST_SIZE; i++)
+        total += hist[i];
+    if (total == 0)
+        return 0.0;
+    for (i = 0; i < REF_HIST_SIZE; i++)
+    {
+        seen += hist[i];
+        if (seen * 100.0 >= pct * total)
+            break;
+    }
+    // upper bound of the bucket, in ms
+    return (i + 1) * REF_HIST_US / 1000.0;
+}
+
+static void report(const struct arena *arena)
+{
+    const struct result *result = arena->result;
+    int b;
+
+    printf("%ld matches\n", result->nb_match);
+    for (b = 0; b < arena->nb_bot; b++)
+        printf("bot%d: wins %ld (%.1f%%) draws %ld points %ld failures %ld"
+               " | turn p50 %.1fms p90 %.1fms p99 %.1fms max %.1fms | %s\n",
+               b, result->wins[b],
+               result->nb_match > 0 ? 100.0 * result->wins[b] / result->nb_match : 0.0,
+               result->draws[b], result->points[b], result->failures[b],
+               percentile(result->hist[b], 50), percentile(result->hist[b], 90),
+               percentile(result->hist[b], 99), percentile(result->hist[b], 100),
+               arena->cmds[b]);
+}
+
+/********************************* MAIN ******************************/
+
+int main(int argc, char **argv)
+{
+    struct arena arena;
+    long nb_match = 1, m;
+    uint32_t seed = 1;
+    int nb_job = 1, j, i;
+
+    memset(&arena, 0x0, sizeof(arena));
+    arena.timeout = 100;
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            nb_match = atol(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            nb_job = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            arena.timeout = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            arena.replay_dir = argv[++i];
+        else if (strcmp(argv[i], "-v") == 0)
+            arena.verbose = true;
+        else if (arena.nb_bot < MAX_PLAYER)
+            arena.cmds[arena.nb_bot++] = argv[i];
+    }
+    if (arena.nb_bot < 2)
+    {
+        fprintf(stderr, "usage: %s [-n matches] [-s seed] [-j jobs] [-t timeout ms]"
+                        " [-r replay dir] [-v] bot0 bot1 [bot2 [bot3]]\n", argv[0]);
+        return -1;
+    }
+    if (nb_job < 1)
+        nb_job = 1;
+
+    arena.result = mmap(NULL, sizeof(struct result), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (arena.result == MAP_FAILED)
+        return -2;
+    memset(arena.result, 0x0, sizeof(struct result));
+    signal(SIGPIPE, SIG_IGN);
+
+    // Job j plays the matches j, j + nb_job...
+    for (j = 0; j < nb_job; j++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            return -3;
+        if (pid == 0)
+        {
+            for (m = j; m < nb_match; m += nb_job)
+                play_match(&arena, seed + m, m);
+            _exit(0);
+        }
+    }
+    for (j = 0; j < nb_job; j++)
+        wait(NULL);
+
+    report(&arena);
+    return 0;
+}
@@ -1,23 +1,608 @@
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+/*
 
-int main()
+gcc main.c -Wall -O2 -o tron
+
+Light cycles on a 30x20 grid, for 2 to 4 players.
+
+The grid is a bitboard of one 32 bit word per row, so that a BFS wave over
+the whole grid is a few shifts and ors per row. A position is scored by
+its Voronoi partition: the free cells we reach strictly before everybody
+else, minus those of the opponent. The search is an iterative deepening
+alpha-beta against the nearest opponent, the others staying where they
+are, with a transposition table, until the turn deadline. Once no
+opponent can reach us, it only looks for the longest way through our
+region.
+
+Build with -DTRACE_SEARCH to print the depth, score and nodes of each turn
+on stderr.
+
+*/
+
+/********************************* BITBOARD ******************************/
+
+#define W           30
+#define H           20
+#define NB_CELL     (W * H)
+#define ROW_MASK    ((1u << W) - 1)
+
+struct bits
+{
+    uint32_t row[H];
+};
+
+static inline bool bits_get(const struct bits *b, int cell)
+{
+    return b->row[cell / W] >> (cell % W) & 1;
+}
+
+static inline void bits_set(struct bits *b, int cell)
+{
+    b->row[cell / W] |= 1u << (cell % W);
+}
+
+static inline void bits_clear(struct bits *b, int cell)
+{
+    b->row[cell / W] &= ~(1u << (cell % W));
+}
+
+static int bits_count(const struct bits *b)
+{
+    int y, n = 0;
+    for (y = 0; y < H; y++)
+        n += __builtin_popcount(b->row[y]);
+    return n;
+}
+
+// out = cells next to the ones of b, and not in mask; out may be b
+static void bits_grow(const struct bits *b, const struct bits *mask, struct bits *out)
+{
+    uint32_t prev = 0, cur, next;
+    int y;
+
+    for (y = 0; y < H; y++)
+    {
+        cur = b->row[y];
+        next = y < H - 1 ? b->row[y + 1] : 0;
+        out->row[y] = (((cur << 1) & ROW_MASK) | (cur >> 1) | prev | next) & ~mask->row[y];
+        prev = cur;
+    }
+}
+
+static bool bits_is_empty(const struct bits *b)
+{
+    int y;
+    uint32_t r = 0;
+    for (y = 0; y < H; y++)
+        r |= b->row[y];
+    return r == 0;
+}
+
+/********************************* TYPEDEF ******************************/
+
+#define MAX_PLAYER      4
+#define MAX_DEPTH       64
+#define WIN             100000
+#define WIN_BOUND       (WIN - 1000)    // scores beyond are won or lost lines
+#define TURN_BUDGET_US  85000
+#define FIRST_BUDGET_US 900000          // the first turn has 1s
+#define TT_BITS         20
+
+enum dir
+{
+    UP = 0,
+    DOWN,
+    LEFT,
+    RIGHT,
+    NB_DIR
+};
+
+enum bound
+{
+    BOUND_EXACT = 0,
+    BOUND_LOWER,
+    BOUND_UPPER
+};
+
+struct tt_entry
+{
+    uint64_t        key;
+    int32_t         score;
+    int8_t          depth;
+    uint8_t         bound;
+    int8_t          dir;
+};
+
+/********************************* GLOBAL DATA ******************************/
+
+int g_nb_players;
+int g_my_id;
+int g_opp;                          // opponent of the search, -1 if none
+bool g_alive[MAX_PLAYER];
+int g_head[MAX_PLAYER];             // cell of each head
+struct bits g_trail[MAX_PLAYER];
+struct bits g_walls;                // trails of the players alive
+
+static const char *g_dir_name[NB_DIR] = {"UP", "DOWN", "LEFT", "RIGHT"};
+
+uint64_t g_zobrist_cell[NB_CELL];
+uint64_t g_zobrist_head[2][NB_CELL];
+uint64_t g_zobrist_side;
+uint64_t g_hash;
+struct tt_entry g_tt[1 << TT_BITS];
+
+int64_t g_deadline;
+bool g_abort;
+long g_nb_node;
+
+/********************************* MAIN ******************************/
+
+static int64_t now_us(void);
+static void zobrist_init(void);
+static bool is_separated(void);
+static enum dir search_duel(int *depth_done, int *score);
+static enum dir search_solo(int *depth_done, int *score);
+
+int main(void)
 {
-    // Read init information from standard input, if any
+    int nb_turn = 0;
+
+    zobrist_init();
 
     while (1)
     {
+        int i, p, x0, y0, x1, y1, depth, score;
+        int64_t start;
+        enum dir dir;
+
         // Read information from standard input
-        int n;
-        scanf("%d", &n);
+        if (scanf("%d %d", &g_nb_players, &g_my_id) != 2)
+            return 0;
+        start = now_us();
+        for (p = 0; p < g_nb_players; p++)
+        {
+            if (scanf("%d %d %d %d", &x0, &y0, &x1, &y1) != 4)
+                return 0;
+            // the trail of a dead player is gone from the grid
+            g_alive[p] = x0 >= 0;
+            if (!g_alive[p])
+            {
+                memset(&g_trail[p], 0x0, sizeof(struct bits));
+                continue;
+            }
+            g_head[p] = y1 * W + x1;
+            bits_set(&g_trail[p], y0 * W + x0);
+            bits_set(&g_trail[p], g_head[p]);
+        }
+        memset(&g_walls, 0x0, sizeof(struct bits));
+        for (p = 0; p < g_nb_players; p++)
+            for (i = 0; i < H; i++)
+                g_walls.row[i] |= g_trail[p].row[i];
 
         // Compute logic here
+        g_deadline = start + (nb_turn == 0 ? FIRST_BUDGET_US : TURN_BUDGET_US);
+        g_abort = false;
+        g_nb_node = 0;
+        if (is_separated())
+            dir = search_solo(&depth, &score);
+        else
+            dir = search_duel(&depth, &score);
 
-        // fprintf(stderr, "Debug messages...\n");
+#ifdef TRACE_SEARCH
+        fprintf(stderr, "%s opp=%d depth=%d score=%d nodes=%ld %lldus\n",
+                g_dir_name[dir], g_opp, depth, score, g_nb_node,
+                (long long)(now_us() - start));
+#endif
 
         // Write action to standard output
-        printf("LEFT\n");
+        printf("%s\n", g_dir_name[dir]);
+        fflush(stdout);
+        nb_turn++;
     }
 
     return 0;
 }
+
+/********************************* FUNCTIONS ******************************/
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t rand64(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void zobrist_init(void)
+{
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    int c;
+
+    for (c = 0; c < NB_CELL; c++)
+    {
+        g_zobrist_cell[c] = rand64(&state);
+        g_zobrist_head[0][c] = rand64(&state);
+        g_zobrist_head[1][c] = rand64(&state);
+    }
+    g_zobrist_side = rand64(&state);
+}
+
+// Cell next to cell in dir, -1 off the grid
+static int cell_move(int cell, enum dir dir)
+{
+    switch (dir)
+    {
+    case UP:
+        return cell >= W ? cell - W : -1;
+    case DOWN:
+        return cell < NB_CELL - W ? cell + W : -1;
+    case LEFT:
+        return cell % W > 0 ? cell - 1 : -1;
+    case RIGHT:
+        return cell % W < W - 1 ? cell + 1 : -1;
+    default:
+        return -1;
+    }
+}
+
+static int nb_free_next(int cell)
+{
+    int d, next, n = 0;
+
+    for (d = 0; d < NB_DIR; d++)
+    {
+        next = cell_move(cell, d);
+        if (next >= 0 && !bits_get(&g_walls, next))
+            n++;
+    }
+    return n;
+}
+
+static bool time_out(void)
+{
+    if ((++g_nb_node & 255) == 0 && now_us() > g_deadline)
+        g_abort = true;
+    return g_abort;
+}
+
+/********************************* EVALUATION ******************************/
+
+// Free cells reachable from cell, in region if not NULL
+static int flood_count(int cell, struct bits *region)
+{
+    struct bits front, reached, mask;
+    int y;
+
+    memset(&front, 0x0, sizeof(struct bits));
+    memset(&reached, 0x0, sizeof(struct bits));
+    bits_set(&front, cell);
+    mask = g_walls;
+    while (1)
+    {
+        bits_grow(&front, &mask, &front);
+        if (bits_is_empty(&front))
+            break;
+        for (y = 0; y < H; y++)
+        {
+            reached.row[y] |= front.row[y];
+            mask.row[y] |= front.row[y];
+        }
+    }
+    if (region != NULL)
+        *region = reached;
+    return bits_count(&reached);
+}
+
+/*
+ * All the heads grow one BFS wave at a time, and each one gets the free
+ * cells it is alone to reach in a wave. Cells reached by several heads in
+ * the same wave are nobody's, and stop the waves as walls do.
+ */
+static void voronoi(int *count)
+{
+    struct bits front[MAX_PLAYER], claimed = g_walls, once, twice;
+    int p, y, nb_active;
+
+    for (p = 0; p < g_nb_players; p++)
+    {
+        count[p] = 0;
+        memset(&front[p], 0x0, sizeof(struct bits));
+        if (g_alive[p])
+            bits_set(&front[p], g_head[p]);
+    }
+
+    do
+    {
+        memset(&once, 0x0, sizeof(struct bits));
+        memset(&twice, 0x0, sizeof(struct bits));
+        for (p = 0; p < g_nb_players; p++)
+        {
+            bits_grow(&front[p], &claimed, &front[p]);
+            for (y = 0; y < H; y++)
+            {
+                twice.row[y] |= once.row[y] & front[p].row[y];
+                once.row[y] |= front[p].row[y];
+            }
+        }
+        nb_active = 0;
+        for (p = 0; p < g_nb_players; p++)
+        {
+            int n;
+            for (y = 0; y < H; y++)
+                front[p].row[y] &= ~twice.row[y];
+            n = bits_count(&front[p]);
+            count[p] += n;
+            nb_active += n > 0;
+        }
+        for (y = 0; y < H; y++)
+            claimed.row[y] |= once.row[y];
+    }
+    while (nb_active > 0);
+}
+
+// Score of the position for us, once both of us have moved
+static int evaluate(void)
+{
+    int count[MAX_PLAYER];
+
+    voronoi(count);
+    return count[g_my_id] - count[g_opp];
+}
+
+// No opponent can reach our region: the game is a race to fill it
+static bool is_separated(void)
+{
+    struct bits region, border;
+    int p, dist, best_dist = NB_CELL;
+
+    g_opp = -1;
+    flood_count(g_head[g_my_id], &region);
+    bits_set(&region, g_head[g_my_id]);
+    memset(&border, 0x0, sizeof(struct bits));
+    bits_grow(&region, &border, &border);
+
+    // the nearest opponent next to our region is the one of the search
+    for (p = 0; p < g_nb_players; p++)
+    {
+        if (p == g_my_id || !g_alive[p] || !bits_get(&border, g_head[p]))
+            continue;
+        dist = abs(g_head[p] % W - g_head[g_my_id] % W) + abs(g_head[p] / W - g_head[g_my_id] / W);
+        if (dist < best_dist)
+        {
+            best_dist = dist;
+            g_opp = p;
+        }
+    }
+    return g_opp < 0;
+}
+
+/********************************* DUEL SEARCH ******************************/
+
+/*
+ * Negamax on plies: side 0 is us, side 1 the opponent, which moves to the
+ * same turn once we have. Its move into our new head is a head-on crash,
+ * a draw. Won and lost scores are WIN minus the ply of the end, stored in
+ * the table relative to the node so that they keep their meaning.
+ */
+static int tt_score_in(int score, int ply)
+{
+    if (score > WIN_BOUND)
+        return score + ply;
+    if (score < -WIN_BOUND)
+        return score - ply;
+    return score;
+}
+
+static int tt_score_out(int score, int ply)
+{
+    if (score > WIN_BOUND)
+        return score - ply;
+    if (score < -WIN_BOUND)
+        return score + ply;
+    return score;
+}
+
+static int negamax(int depth, int ply, int alpha, int beta, int side)
+{
+    int p = side == 0 ? g_my_id : g_opp;
+    int head = g_head[p], alpha_in = alpha;
+    int d, i, next, score, best = -WIN - 1, best_dir = -1, nb_move = 0;
+    int order[NB_DIR];
+    uint64_t key = g_hash ^ (side ? g_zobrist_side : 0);
+    struct tt_entry *tt = &g_tt[key & ((1 << TT_BITS) - 1)];
+
+    if (time_out())
+        return 0;
+    if (side == 0 && depth <= 0)
+        return evaluate();
+
+    for (d = 0; d < NB_DIR; d++)
+        order[d] = d;
+    if (tt->key == key)
+    {
+        if (tt->depth >= depth)
+        {
+            score = tt_score_out(tt->score, ply);
+            if (tt->bound == BOUND_EXACT ||
+                (tt->bound == BOUND_LOWER && score >= beta) ||
+                (tt->bound == BOUND_UPPER && score <= alpha))
+                return score;
+        }
+        if (tt->dir >= 0)
+        {
+            order[tt->dir] = 0;
+            order[0] = tt->dir;
+        }
+    }
+
+    for (i = 0; i < NB_DIR; i++)
+    {
+        d = order[i];
+        next = cell_move(head, d);
+        if (next < 0)
+            continue;
+        if (bits_get(&g_walls, next))
+        {
+            if (side == 1 && next == g_head[g_my_id] && best < 0)
+            {
+                best = 0;
+                best_dir = d;
+            }
+            continue;
+        }
+        nb_move++;
+
+        bits_set(&g_walls, next);
+        g_hash ^= g_zobrist_cell[next] ^ g_zobrist_head[side][head] ^ g_zobrist_head[side][next];
+        g_head[p] = next;
+        score = -negamax(depth - 1, ply + 1, -beta, -alpha, 1 - side);
+        g_head[p] = head;
+        g_hash ^= g_zobrist_cell[next] ^ g_zobrist_head[side][head] ^ g_zobrist_head[side][next];
+        bits_clear(&g_walls, next);
+        if (g_abort)
+            return 0;
+
+        if (score > best)
+        {
+            best = score;
+            best_dir = d;
+        }
+        if (best > alpha)
+            alpha = best;
+        if (alpha >= beta)
+            break;
+    }
+
+    if (nb_move == 0 && best_dir < 0)
+    {
+        // we are stuck: a draw if the opponent is too, since it moves the same turn
+        if (side == 0 && nb_free_next(g_head[g_opp]) == 0)
+            return 0;
+        return -WIN + ply;
+    }
+
+    tt->key = key;
+    tt->score = tt_score_in(best, ply);
+    tt->depth = depth;
+    tt->dir = best_dir;
+    tt->bound = best <= alpha_in ? BOUND_UPPER : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+    return best;
+}
+
+static enum dir search_duel(int *depth_done, int *score)
+{
+    enum dir best_dir = UP;
+    int depth, d;
+
+    // the table is kept from turn to turn, so the hash covers all the walls
+    g_hash = g_zobrist_head[0][g_head[g_my_id]] ^ g_zobrist_head[1][g_head[g_opp]];
+    for (d = 0; d < NB_CELL; d++)
+        if (bits_get(&g_walls, d))
+            g_hash ^= g_zobrist_cell[d];
+    for (d = 0; d < NB_DIR; d++)
+    {
+        int next = cell_move(g_head[g_my_id], d);
+        if (next >= 0 && !bits_get(&g_walls, next))
+        {
+            best_dir = d;
+            break;
+        }
+    }
+    *depth_done = 0;
+    *score = 0;
+
+    for (depth = 2; depth <= MAX_DEPTH; depth += 2)
+    {
+        struct tt_entry *tt;
+        int s = negamax(depth, 0, -WIN - 1, WIN + 1, 0);
+        if (g_abort)
+            break;
+        tt = &g_tt[g_hash & ((1 << TT_BITS) - 1)];
+        if (tt->key == g_hash && tt->dir >= 0)
+            best_dir = tt->dir;
+        *depth_done = depth;
+        *score = s;
+        if (s > WIN_BOUND || s < -WIN_BOUND)
+            break;
+    }
+    return best_dir;
+}
+
+/********************************* SOLO SEARCH ******************************/
+
+// Moves we can still make within depth, plus the cells left reachable then
+static int solo(int depth)
+{
+    int head = g_head[g_my_id];
+    int d, next, score, best = 0;
+
+    if (time_out())
+        return 0;
+    if (depth == 0)
+        return flood_count(head, NULL);
+
+    for (d = 0; d < NB_DIR; d++)
+    {
+        next = cell_move(head, d);
+        if (next < 0 || bits_get(&g_walls, next))
+            continue;
+        bits_set(&g_walls, next);
+        g_head[g_my_id] = next;
+        score = 1 + solo(depth - 1);
+        g_head[g_my_id] = head;
+        bits_clear(&g_walls, next);
+        if (score > best)
+            best = score;
+    }
+    return best;
+}
+
+static enum dir search_solo(int *depth_done, int *score)
+{
+    int head = g_head[g_my_id];
+    int depth, d, next, s, best, area = flood_count(head, NULL);
+    enum dir best_dir = UP, dir;
+
+    *depth_done = 0;
+    *score = 0;
+    for (depth = 1; depth <= area && depth <= MAX_DEPTH; depth++)
+    {
+        // on a tie, hug the walls: the move with the fewest free neighbours wastes the least
+        best = -1;
+        dir = UP;
+        for (d = 0; d < NB_DIR; d++)
+        {
+            next = cell_move(head, d);
+            if (next < 0 || bits_get(&g_walls, next))
+                continue;
+            bits_set(&g_walls, next);
+            g_head[g_my_id] = next;
+            s = (1 + solo(depth - 1)) * NB_DIR + NB_DIR - 1 - nb_free_next(next);
+            g_head[g_my_id] = head;
+            bits_clear(&g_walls, next);
+            if (s > best)
+            {
+                best = s;
+                dir = d;
+            }
+        }
+        if (g_abort || best < 0)
+            break;
+        best_dir = dir;
+        *depth_done = depth;
+        *score = best / NB_DIR;
+    }
+    return best_dir;
+}